@@ -13,51 +13,218 @@
 #ifndef LLVM_EXECUTIONENGINE_ORC_QUAIL_H
 #define LLVM_EXECUTIONENGINE_ORC_QUAIL_H
 
+#include "SlabMemoryManager.h"
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ExecutionEngine/JITSymbol.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/ExecutionEngine/Orc/CompileOnDemandLayer.h"
 #include "llvm/ExecutionEngine/Orc/CompileUtils.h"
 #include "llvm/ExecutionEngine/Orc/Core.h"
+#include "llvm/ExecutionEngine/Orc/EPCEHFrameRegistrar.h"
 #include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
 #include "llvm/ExecutionEngine/Orc/ExecutorProcessControl.h"
 #include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
+#include "llvm/ExecutionEngine/Orc/IndirectionUtils.h"
 #include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/LazyReexports.h"
+#include "llvm/ExecutionEngine/Orc/ObjectLinkingLayer.h"
 #include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
 #include "llvm/ExecutionEngine/Orc/Shared/ExecutorSymbolDef.h"
+#include "llvm/ExecutionEngine/Orc/TaskDispatch.h"
 #include "llvm/ExecutionEngine/SectionMemoryManager.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/Support/raw_ostream.h"
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace llvm {
 namespace orc {
 
+/// QuailJITOptions - Session wide settings for the JIT, filled in from the
+/// command line before the JIT is created.
+struct QuailJITOptions {
+  /// Defer compiling each function body until the first time it is called.
+  bool LazyCompile = false;
+  /// Compile definitions without optimizations first, and recompile the hot
+  /// ones at -O2 behind an indirection stub.
+  bool Tiered = false;
+  /// Number of threads used to compile and link in the background. 0 keeps
+  /// all work on the thread that asked for it.
+  unsigned NumThreads = 0;
+  /// Link objects in place with JITLink instead of RuntimeDyld.
+  bool UseJITLink = false;
+  /// Pack RuntimeDyld sections into shared slabs, instead of giving each
+  /// object its own SectionMemoryManager. Has no effect with UseJITLink.
+  bool SlabAllocator = false;
+  /// Cache that compiled objects are looked up in and stored to, or null.
+  ObjectCache *ObjCache = nullptr;
+  /// CPU to generate code for. Empty means a generic CPU for the triple.
+  std::string CPU;
+  /// Subtarget features on top of the CPU's, e.g. "+avx2".
+  std::vector<std::string> Features;
+};
+
+/// FixedThreadPoolTaskDispatcher - Runs the session's materialization tasks on
+/// a fixed number of worker threads.
+class FixedThreadPoolTaskDispatcher : public TaskDispatcher {
+private:
+  std::mutex QueueMutex;
+  std::condition_variable QueueCV;
+  std::deque<std::unique_ptr<Task>> Queue;
+  std::vector<std::thread> Workers;
+  bool Running = true;
+
+  void work() {
+    while (true) {
+      std::unique_ptr<Task> T;
+      {
+        std::unique_lock<std::mutex> Lock(QueueMutex);
+        QueueCV.wait(Lock, [this]() { return !Running || !Queue.empty(); });
+        // Only stop once everything that was queued has run.
+        if (Queue.empty())
+          return;
+        T = std::move(Queue.front());
+        Queue.pop_front();
+      }
+      T->run();
+    }
+  }
+
+public:
+  FixedThreadPoolTaskDispatcher(unsigned NumThreads) {
+    for (unsigned I = 0; I < NumThreads; ++I)
+      Workers.emplace_back([this]() { work(); });
+  }
+
+  ~FixedThreadPoolTaskDispatcher() { shutdown(); }
+
+  void dispatch(std::unique_ptr<Task> T) override {
+    std::unique_lock<std::mutex> Lock(QueueMutex);
+    if (!Running) {
+      // The workers are gone, or only finishing what was queued before
+      // shutdown, so nothing would pick this up. Run it here instead, like
+      // InPlaceTaskDispatcher does.
+      Lock.unlock();
+      T->run();
+      return;
+    }
+    Queue.push_back(std::move(T));
+    Lock.unlock();
+    QueueCV.notify_one();
+  }
+
+  void shutdown() override {
+    {
+      std::lock_guard<std::mutex> Lock(QueueMutex);
+      Running = false;
+    }
+    QueueCV.notify_all();
+    for (std::thread &Worker : Workers)
+      Worker.join();
+    Workers.clear();
+  }
+};
+
 class QuailJIT {
 private:
   std::unique_ptr<ExecutionSession> ES;
 
   DataLayout DL;
+  JITTargetMachineBuilder TMBuilder;
   MangleAndInterner Mangle;
 
-  RTDyldObjectLinkingLayer ObjectLayer;
+  std::unique_ptr<SlabMemoryPool> SlabPool;
+  std::unique_ptr<ObjectLayer> LinkLayer;
   IRCompileLayer CompileLayer;
 
+  // Only used in lazy mode. Calls go through a stub that compiles the body
+  // on first use and then jumps straight to it from then on.
+  std::unique_ptr<LazyCallThroughManager> LCTMgr;
+  std::unique_ptr<CompileOnDemandLayer> CODLayer;
+
+  // Only used in tiered mode. Every tiered function is called through a stub
+  // that is repointed from the tier 0 body to the optimized one.
+  std::unique_ptr<IRCompileLayer> OptimizedCompileLayer;
+  std::unique_ptr<IndirectStubsManager> TierStubs;
+
   JITDylib &MainJD;
 
+  static void handleLazyCallThroughError() {
+    errs() << "LazyCallThrough error: Could not find function body\n";
+    exit(1);
+  }
+
+  static Expected<std::unique_ptr<ObjectLayer>>
+  createLinkLayer(ExecutionSession &ES, const QuailJITOptions &Options,
+                  SlabMemoryPool *SlabPool) {
+    if (Options.UseJITLink) {
+      auto Registrar = EPCEHFrameRegistrar::Create(ES);
+      if (!Registrar)
+        return Registrar.takeError();
+      auto Layer = std::make_unique<ObjectLinkingLayer>(ES);
+      Layer->addPlugin(std::make_unique<EHFrameRegistrationPlugin>(
+          ES, std::move(*Registrar)));
+      return std::move(Layer);
+    }
+
+    RTDyldObjectLinkingLayer::GetMemoryManagerFunction GetMemMgr =
+        []() { return std::make_unique<SectionMemoryManager>(); };
+    if (SlabPool)
+      GetMemMgr = [SlabPool]() {
+        return std::make_unique<SlabMemoryManager>(*SlabPool);
+      };
+
+    auto Layer =
+        std::make_unique<RTDyldObjectLinkingLayer>(ES, std::move(GetMemMgr));
+    if (ES.getExecutorProcessControl().getTargetTriple().isOSBinFormatCOFF()) {
+      Layer->setOverrideObjectFlagsWithResponsibilityFlags(true);
+      Layer->setAutoClaimResponsibilityForObjectSymbols(true);
+    }
+    return std::move(Layer);
+  }
+
 public:
   QuailJIT(std::unique_ptr<ExecutionSession> ES,
-                  JITTargetMachineBuilder JTMB, DataLayout DL)
-      : ES(std::move(ES)), DL(std::move(DL)), Mangle(*this->ES, this->DL),
-        ObjectLayer(*this->ES,
-                    []() { return std::make_unique<SectionMemoryManager>(); }),
-        CompileLayer(*this->ES, ObjectLayer,
-                     std::make_unique<ConcurrentIRCompiler>(std::move(JTMB))),
+                  JITTargetMachineBuilder JTMB, DataLayout DL,
+                  const QuailJITOptions &Options,
+                  std::unique_ptr<SlabMemoryPool> SlabPool,
+                  std::unique_ptr<ObjectLayer> LinkLayer,
+                  std::unique_ptr<LazyCallThroughManager> LCTMgr = nullptr)
+      : ES(std::move(ES)), DL(std::move(DL)), TMBuilder(JTMB),
+        Mangle(*this->ES, this->DL),
+        SlabPool(std::move(SlabPool)), LinkLayer(std::move(LinkLayer)),
+        CompileLayer(*this->ES, *this->LinkLayer,
+                     std::make_unique<ConcurrentIRCompiler>(JTMB, Options.ObjCache)),
+        LCTMgr(std::move(LCTMgr)),
         MainJD(this->ES->createBareJITDylib("<main>")) {
     MainJD.addGenerator(
         cantFail(DynamicLibrarySearchGenerator::GetForCurrentProcess(
             DL.getGlobalPrefix())));
-    if (JTMB.getTargetTriple().isOSBinFormatCOFF()) {
-      ObjectLayer.setOverrideObjectFlagsWithResponsibilityFlags(true);
-      ObjectLayer.setAutoClaimResponsibilityForObjectSymbols(true);
+    if (this->LCTMgr) {
+      CODLayer = std::make_unique<CompileOnDemandLayer>(
+          *this->ES, CompileLayer, *this->LCTMgr,
+          createLocalIndirectStubsManagerBuilder(JTMB.getTargetTriple()));
+      // Split modules per function, so only the bodies that are actually
+      // called get compiled.
+      CODLayer->setPartitionFunction(CompileOnDemandLayer::compileRequested);
+    }
+    if (Options.Tiered) {
+      JITTargetMachineBuilder OptJTMB = JTMB;
+      OptJTMB.setCodeGenOptLevel(CodeGenOptLevel::Default);
+      OptimizedCompileLayer = std::make_unique<IRCompileLayer>(
+          *this->ES, *this->LinkLayer,
+          std::make_unique<ConcurrentIRCompiler>(std::move(OptJTMB),
+                                                 Options.ObjCache));
+      TierStubs =
+          createLocalIndirectStubsManagerBuilder(JTMB.getTargetTriple())();
     }
   }
 
@@ -66,8 +233,14 @@ public:
       ES->reportError(std::move(Err));
   }
 
-  static Expected<std::unique_ptr<QuailJIT>> Create() {
-    auto EPC = SelfExecutorProcessControl::Create();
+  static Expected<std::unique_ptr<QuailJIT>>
+  Create(const QuailJITOptions &Options = QuailJITOptions()) {
+    std::unique_ptr<TaskDispatcher> Dispatcher;
+    if (Options.NumThreads > 0)
+      Dispatcher =
+          std::make_unique<FixedThreadPoolTaskDispatcher>(Options.NumThreads);
+
+    auto EPC = SelfExecutorProcessControl::Create(nullptr, std::move(Dispatcher));
     if (!EPC)
       return EPC.takeError();
 
@@ -76,27 +249,125 @@ public:
     JITTargetMachineBuilder JTMB(
         ES->getExecutorProcessControl().getTargetTriple());
 
+    if (!Options.CPU.empty())
+      JTMB.setCPU(Options.CPU);
+    JTMB.addFeatures(Options.Features);
+
+    // Tier 0 favours compile speed over code quality.
+    if (Options.Tiered)
+      JTMB.setCodeGenOptLevel(CodeGenOptLevel::None);
+
     auto DL = JTMB.getDefaultDataLayoutForTarget();
     if (!DL)
       return DL.takeError();
 
+    std::unique_ptr<SlabMemoryPool> SlabPool;
+    if (Options.SlabAllocator && !Options.UseJITLink)
+      SlabPool = std::make_unique<SlabMemoryPool>();
+
+    auto LinkLayer = createLinkLayer(*ES, Options, SlabPool.get());
+    if (!LinkLayer)
+      return LinkLayer.takeError();
+
+    std::unique_ptr<LazyCallThroughManager> LCTMgr;
+    if (Options.LazyCompile) {
+      auto LCTM = createLocalLazyCallThroughManager(
+          JTMB.getTargetTriple(), *ES,
+          ExecutorAddr::fromPtr(&handleLazyCallThroughError));
+      if (!LCTM)
+        return LCTM.takeError();
+      LCTMgr = std::move(*LCTM);
+    }
+
     return std::make_unique<QuailJIT>(std::move(ES), std::move(JTMB),
-                                             std::move(*DL));
+                                             std::move(*DL), Options,
+                                             std::move(SlabPool),
+                                             std::move(*LinkLayer),
+                                             std::move(LCTMgr));
   }
 
   const DataLayout &getDataLayout() const { return DL; }
 
+  const Triple &getTargetTriple() const { return TMBuilder.getTargetTriple(); }
+
+  /// createTargetMachine - A TargetMachine for the CPU and features code is
+  /// compiled for, so the optimizer can use its cost models.
+  Expected<std::unique_ptr<TargetMachine>> createTargetMachine() {
+    return TMBuilder.createTargetMachine();
+  }
+
+  /// getSlabPool - The shared slab pool, or null if the slab allocator is not
+  /// in use.
+  SlabMemoryPool *getSlabPool() { return SlabPool.get(); }
+
   JITDylib &getMainJITDylib() { return MainJD; }
 
   Error addModule(ThreadSafeModule TSM, ResourceTrackerSP RT = nullptr) {
     if (!RT)
       RT = MainJD.getDefaultResourceTracker();
+    if (CODLayer)
+      return CODLayer->add(RT, std::move(TSM));
     return CompileLayer.add(RT, std::move(TSM));
   }
 
+  /// compileInBackground - Start materializing Name without waiting for it to
+  /// finish. With a thread pool the work runs off the calling thread.
+  void compileInBackground(StringRef Name) {
+    ES->lookup(
+        LookupKind::Static, makeJITDylibSearchOrder(&MainJD),
+        SymbolLookupSet(Mangle(Name.str())), SymbolState::Ready,
+        [this](Expected<SymbolMap> Result) {
+          if (!Result)
+            ES->reportError(Result.takeError());
+        },
+        NoDependenciesToRegister);
+  }
+
+  /// addOptimizedModule - Compile TSM with full codegen optimizations. Used
+  /// for functions that have been tiered up.
+  Error addOptimizedModule(ThreadSafeModule TSM) {
+    return OptimizedCompileLayer->add(MainJD.getDefaultResourceTracker(),
+                                      std::move(TSM));
+  }
+
+  /// addTierStub - Define Name as a stub that callers jump through. It has
+  /// no target until updateTierStub is called.
+  Error addTierStub(StringRef Name) {
+    if (auto Err = TierStubs->createStub(
+            Name, ExecutorAddr(),
+            JITSymbolFlags::Exported | JITSymbolFlags::Callable))
+      return Err;
+    return MainJD.define(
+        absoluteSymbols({{Mangle(Name.str()), TierStubs->findStub(Name, false)}}));
+  }
+
+  Error updateTierStub(StringRef Name, ExecutorAddr Body) {
+    return TierStubs->updatePointer(Name, Body);
+  }
+
   Expected<ExecutorSymbolDef> lookup(StringRef Name) {
     return ES->lookup({&MainJD}, Mangle(Name.str()));
   }
+
+  /// lookupAll - Look up several symbols with one query. The definitions are
+  /// returned in the same order as Names.
+  Expected<std::vector<ExecutorSymbolDef>>
+  lookupAll(ArrayRef<std::string> Names) {
+    std::vector<SymbolStringPtr> Mangled;
+    SymbolLookupSet Symbols;
+    for (const std::string &Name : Names) {
+      Mangled.push_back(Mangle(Name));
+      Symbols.add(Mangled.back());
+    }
+    auto Result =
+        ES->lookup(makeJITDylibSearchOrder(&MainJD), std::move(Symbols));
+    if (!Result)
+      return Result.takeError();
+    std::vector<ExecutorSymbolDef> Defs;
+    for (const SymbolStringPtr &Name : Mangled)
+      Defs.push_back((*Result)[Name]);
+    return Defs;
+  }
 };
 
 } // end namespace orc
@@ -0,0 +1,346 @@
+//===- SlabMemoryManager.h - Shared slab memory for QuailJIT ---*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// A RuntimeDyld memory manager that packs the sections of many small objects
+// into shared slabs, instead of giving every object its own pages.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_EXECUTIONENGINE_ORC_QUAIL_SLABMEMORYMANAGER_H
+#define LLVM_EXECUTIONENGINE_ORC_QUAIL_SLABMEMORYMANAGER_H
+
+#include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
+#include "llvm/ExecutionEngine/RuntimeDyld.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/Memory.h"
+#include "llvm/Support/Process.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace llvm {
+namespace orc {
+
+/// SlabMemoryPool - Slabs of memory that objects carve their sections out
+/// of. Ranges handed back are reused by later objects, and a slab is unmapped
+/// once nothing in it is live.
+///
+/// Code and read-only data slabs are mapped twice over the same memory: once
+/// read/write, where RuntimeDyld writes and relocates sections, and once
+/// read/execute or read-only, which is the address the section is run and
+/// read from. No mapping is ever writable and executable, and protections
+/// never change, so sections of any number of objects share a page whether
+/// they are still being loaded or not. The price is that the read/write alias
+/// of finalized code stays mapped for as long as the slab lives, and that
+/// each of those slabs takes twice its size in address space (not in memory).
+///
+/// Dual mapping needs a shared memory object, so it is not available on
+/// every platform; see isSupported().
+class SlabMemoryPool {
+public:
+  enum Purpose { Code, ROData, Data, NumPurposes };
+
+private:
+  struct Slab {
+    uintptr_t Size;
+    uintptr_t View; // Where the slab is run or read from, 0 if Data
+  };
+  typedef std::map<uintptr_t, Slab> SlabMap;
+  // Start address -> size, for the free ranges inside the slabs.
+  typedef std::map<uintptr_t, uintptr_t> RangeMap;
+
+  std::mutex PoolMutex;
+  uintptr_t SlabSize;
+  uintptr_t PageSize;
+  SlabMap Slabs[NumPurposes];
+  RangeMap FreeRanges[NumPurposes];
+  size_t MappedBytes = 0;
+  size_t UsedBytes = 0;
+
+  // Map Size bytes twice, read/write at Writable and with Prot at View.
+  static bool mapDual(uintptr_t Size, int Prot, uintptr_t &Writable,
+                      uintptr_t &View) {
+#ifdef _WIN32
+    return false;
+#else
+#ifdef __linux__
+    int FD = memfd_create("quail-jit", MFD_CLOEXEC);
+#else
+    static std::atomic<unsigned> Counter(0);
+    std::string Name = "/quail-jit-" + std::to_string(getpid()) + "-" +
+                       std::to_string(Counter++);
+    int FD = shm_open(Name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (FD >= 0)
+      shm_unlink(Name.c_str());
+#endif
+    if (FD < 0)
+      return false;
+    // The mappings keep the memory alive on their own.
+    void *RW = MAP_FAILED, *RO = MAP_FAILED;
+    if (ftruncate(FD, Size) == 0) {
+      RW = mmap(nullptr, Size, PROT_READ | PROT_WRITE, MAP_SHARED, FD, 0);
+      RO = mmap(nullptr, Size, Prot, MAP_SHARED, FD, 0);
+    }
+    close(FD);
+    if (RW == MAP_FAILED || RO == MAP_FAILED) {
+      if (RW != MAP_FAILED)
+        munmap(RW, Size);
+      if (RO != MAP_FAILED)
+        munmap(RO, Size);
+      return false;
+    }
+    Writable = reinterpret_cast<uintptr_t>(RW);
+    View = reinterpret_cast<uintptr_t>(RO);
+    return true;
+#endif
+  }
+
+  static int getViewProtection(Purpose P) {
+#ifdef _WIN32
+    return 0;
+#else
+    return P == Code ? PROT_READ | PROT_EXEC : PROT_READ;
+#endif
+  }
+
+  // Take Size bytes aligned to Alignment from the first free range that fits.
+  uint8_t *takeFreeRange(Purpose P, uintptr_t Size, uintptr_t Alignment) {
+    RangeMap &Free = FreeRanges[P];
+    for (auto It = Free.begin(); It != Free.end(); ++It) {
+      uintptr_t Start = It->first;
+      uintptr_t End = It->first + It->second;
+      uintptr_t Addr = alignTo(Start, Alignment);
+      if (Addr + Size > End)
+        continue;
+
+      Free.erase(It);
+      if (Addr != Start)
+        Free[Start] = Addr - Start;
+      if (Addr + Size != End)
+        Free[Addr + Size] = End - (Addr + Size);
+      return reinterpret_cast<uint8_t *>(Addr);
+    }
+    return nullptr;
+  }
+
+  bool mapSlab(Purpose P, uintptr_t MinSize) {
+    uintptr_t Size = alignTo(std::max(SlabSize, MinSize), PageSize);
+
+    uintptr_t Start, View = 0;
+    if (P == Data) {
+      std::error_code EC;
+      sys::MemoryBlock Block = sys::Memory::allocateMappedMemory(
+          Size, nullptr, sys::Memory::MF_READ | sys::Memory::MF_WRITE, EC);
+      if (EC)
+        return false;
+      Start = reinterpret_cast<uintptr_t>(Block.base());
+      Size = Block.allocatedSize();
+    } else if (!mapDual(Size, getViewProtection(P), Start, View)) {
+      return false;
+    }
+
+    Slabs[P][Start] = {Size, View};
+    FreeRanges[P][Start] = Size;
+    MappedBytes += Size;
+    return true;
+  }
+
+  static void unmap(uintptr_t Start, const Slab &S) {
+    sys::MemoryBlock Block(reinterpret_cast<void *>(Start), S.Size);
+    sys::Memory::releaseMappedMemory(Block);
+    if (S.View) {
+      sys::MemoryBlock ViewBlock(reinterpret_cast<void *>(S.View), S.Size);
+      sys::Memory::releaseMappedMemory(ViewBlock);
+    }
+  }
+
+public:
+  SlabMemoryPool(uintptr_t SlabSize = 256 * 1024)
+      : SlabSize(SlabSize), PageSize(sys::Process::getPageSizeEstimate()) {}
+
+  ~SlabMemoryPool() {
+    for (SlabMap &PurposeSlabs : Slabs)
+      for (auto &S : PurposeSlabs)
+        unmap(S.first, S.second);
+  }
+
+  /// isSupported - Whether code can be dual mapped here. Checked by mapping
+  /// one page, since the OS can refuse executable shared memory.
+  static bool isSupported() {
+    uintptr_t PageSize = sys::Process::getPageSizeEstimate();
+    uintptr_t Writable, View;
+    if (!mapDual(PageSize, getViewProtection(Code), Writable, View))
+      return false;
+    unmap(Writable, {PageSize, View});
+    return true;
+  }
+
+  /// allocate - Size writable bytes, or null if no more memory can be mapped.
+  uint8_t *allocate(Purpose P, uintptr_t Size, unsigned Alignment) {
+    std::lock_guard<std::mutex> Lock(PoolMutex);
+    uintptr_t Align = Alignment ? Alignment : 16;
+    Size = std::max<uintptr_t>(Size, 1);
+
+    uint8_t *Addr = takeFreeRange(P, Size, Align);
+    if (!Addr && mapSlab(P, Size + Align))
+      Addr = takeFreeRange(P, Size, Align);
+    if (Addr)
+      UsedBytes += Size;
+    return Addr;
+  }
+
+  /// getViewAddress - Where the allocation at Ptr is run or read from. The
+  /// same as Ptr for writable data.
+  uint8_t *getViewAddress(Purpose P, uint8_t *Ptr) {
+    std::lock_guard<std::mutex> Lock(PoolMutex);
+    uintptr_t Addr = reinterpret_cast<uintptr_t>(Ptr);
+    auto S = std::prev(Slabs[P].upper_bound(Addr));
+    if (!S->second.View)
+      return Ptr;
+    return reinterpret_cast<uint8_t *>(S->second.View + (Addr - S->first));
+  }
+
+  void release(Purpose P, uint8_t *Ptr, uintptr_t Size) {
+    std::lock_guard<std::mutex> Lock(PoolMutex);
+    Size = std::max<uintptr_t>(Size, 1);
+    UsedBytes -= Size;
+
+    uintptr_t Start = reinterpret_cast<uintptr_t>(Ptr);
+    uintptr_t End = Start + Size;
+
+    // Find the slab the range lives in, so it is never merged across slabs.
+    SlabMap &PurposeSlabs = Slabs[P];
+    auto S = std::prev(PurposeSlabs.upper_bound(Start));
+    uintptr_t SlabStart = S->first;
+    uintptr_t SlabEnd = S->first + S->second.Size;
+
+    // Coalesce with the free neighbours on either side.
+    RangeMap &Free = FreeRanges[P];
+    auto Next = Free.lower_bound(Start);
+    if (Next != Free.end() && Next->first == End && Next->first < SlabEnd) {
+      End += Next->second;
+      Next = Free.erase(Next);
+    }
+    if (Next != Free.begin()) {
+      auto Prev = std::prev(Next);
+      if (Prev->first >= SlabStart && Prev->first + Prev->second == Start) {
+        Start = Prev->first;
+        Free.erase(Prev);
+      }
+    }
+
+    if (Start == SlabStart && End == SlabEnd) {
+      MappedBytes -= S->second.Size;
+      unmap(SlabStart, S->second);
+      PurposeSlabs.erase(S);
+      return;
+    }
+    Free[Start] = End - Start;
+  }
+
+  /// getMappedBytes - Bytes of memory backing the slabs. A dual mapped slab
+  /// is only counted once.
+  size_t getMappedBytes() {
+    std::lock_guard<std::mutex> Lock(PoolMutex);
+    return MappedBytes;
+  }
+
+  /// getUsedBytes - Bytes handed out to sections that are still live.
+  size_t getUsedBytes() {
+    std::lock_guard<std::mutex> Lock(PoolMutex);
+    return UsedBytes;
+  }
+};
+
+/// SlabMemoryManager - Per-object memory manager that takes its sections from
+/// a shared SlabMemoryPool, and gives them back when the object is removed.
+///
+/// Sections are handed to RuntimeDyld at their writable address. Once the
+/// object is loaded each one is moved to its view address, so relocations
+/// and symbols are worked out against the address the code runs at.
+class SlabMemoryManager : public RTDyldMemoryManager {
+private:
+  struct Allocation {
+    SlabMemoryPool::Purpose Purpose;
+    uint8_t *Addr;
+    uint8_t *View;
+    uintptr_t Size;
+  };
+
+  SlabMemoryPool &Pool;
+  std::vector<Allocation> Allocations;
+
+  uint8_t *allocate(SlabMemoryPool::Purpose P, uintptr_t Size,
+                    unsigned Alignment) {
+    uint8_t *Addr = Pool.allocate(P, Size, Alignment);
+    if (Addr)
+      Allocations.push_back({P, Addr, Pool.getViewAddress(P, Addr), Size});
+    return Addr;
+  }
+
+public:
+  SlabMemoryManager(SlabMemoryPool &Pool) : Pool(Pool) {}
+
+  ~SlabMemoryManager() override {
+    for (Allocation &A : Allocations)
+      Pool.release(A.Purpose, A.Addr, A.Size);
+  }
+
+  uint8_t *allocateCodeSection(uintptr_t Size, unsigned Alignment,
+                               unsigned SectionID,
+                               StringRef SectionName) override {
+    return allocate(SlabMemoryPool::Code, Size, Alignment);
+  }
+
+  uint8_t *allocateDataSection(uintptr_t Size, unsigned Alignment,
+                               unsigned SectionID, StringRef SectionName,
+                               bool IsReadOnly) override {
+    return allocate(IsReadOnly ? SlabMemoryPool::ROData : SlabMemoryPool::Data,
+                    Size, Alignment);
+  }
+
+  using RTDyldMemoryManager::notifyObjectLoaded;
+  void notifyObjectLoaded(RuntimeDyld &RTDyld,
+                          const object::ObjectFile &Obj) override {
+    for (Allocation &A : Allocations)
+      if (A.View != A.Addr)
+        RTDyld.mapSectionAddress(A.Addr, reinterpret_cast<uintptr_t>(A.View));
+  }
+
+  /// registerEHFrames - Register the frames where they are read from, since
+  /// their pointers were relocated against that address.
+  void registerEHFrames(uint8_t *Addr, uint64_t LoadAddr,
+                        size_t Size) override {
+    RTDyldMemoryManager::registerEHFrames(reinterpret_cast<uint8_t *>(LoadAddr),
+                                          LoadAddr, Size);
+  }
+
+  bool finalizeMemory(std::string *ErrMsg) override {
+    for (Allocation &A : Allocations)
+      if (A.Purpose == SlabMemoryPool::Code)
+        sys::Memory::InvalidateInstructionCache(A.View, A.Size);
+    return false;
+  }
+};
+
+} // end namespace orc
+} // end namespace llvm
+
+#endif // LLVM_EXECUTIONENGINE_ORC_QUAIL_SLABMEMORYMANAGER_H
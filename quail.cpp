@@ -5,23 +5,37 @@
 #include "./src/logging.h"
 #include "./src/output.h"
 #include "./src/codegen/optimizations.h"
+#include "./src/scan.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <filesystem>
 #include <iostream>
 #include <string>
 #include <vector>
 
 /// top ::= definition | external | expression | ';'
-void JitLine() {
+/// Returns false once stdin has ended.
+bool JitLine() {
     resetLexer();
     std::cout << ">>> ";
-    initBuffer();
+    if (!initBuffer()) {
+        std::cout << "\n";
+        return false;
+    }
     try {
         while (true) {
+            dropConsumedInput();
             switch (CurTok) {
             case tok_eof:
+                CG::FlushTopLevelExpressions();
                 std::cout << "\n";
-                return;
+                return true;
             case tok_def:
+                // Definitions take over the current module, so the batch
+                // has to run first.
+                CG::FlushTopLevelExpressions();
                 CG::HandleDefinitionJit();
                 break;
             case tok_extern:
@@ -35,16 +49,18 @@ void JitLine() {
     }
     catch (CompileError ce){
         DebugLog("Error Recovered\n");
+        // Expressions before the error still run
+        CG::FlushTopLevelExpressions();
     }
+    return true;
 }
 
 void MainLoop(){
     InitializeBinopPrecedence();
     CG::InitializeCodegen();
     CG::InitializeModuleAndManagers();
-    while (true){
-        JitLine();
-    }
+    while (JitLine())
+        ;
 }
 
 void compileFile(char* filepath, char* savename) {
@@ -57,6 +73,7 @@ void compileFile(char* filepath, char* savename) {
     try {
         bool looping = true;
         while (looping) {
+            dropConsumedInput();
             switch (CurTok) {
             case tok_eof:
                 std::cout << "\n";
@@ -80,12 +97,61 @@ void compileFile(char* filepath, char* savename) {
     }
 }
 
+/// benchLexer - Lex a file over and over with each scanner this CPU supports,
+/// and print the throughput of each.
+void benchLexer(char* filepath) {
+    InitializeBinopPrecedence();
+    std::error_code ec;
+    uintmax_t size = std::filesystem::file_size(filepath, ec);
+    if (ec || size == 0) {
+        std::cout << "Can not benchmark '" << filepath << "'\n";
+        return;
+    }
+
+    const char* defaultScanner = getScanImplementation();
+    for (const char* scanner : getScanImplementations()) {
+        setScanImplementation(scanner);
+        uintmax_t bytes = 0;
+        size_t tokens = 0;
+        auto start = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed(0);
+        while (elapsed.count() < 1.0) {
+            resetLexer();
+            readFile(filepath);
+            while (CurTok != tok_eof) {
+                tokens++;
+                getNextToken();
+            }
+            bytes += size;
+            elapsed = std::chrono::steady_clock::now() - start;
+        }
+        printf("%-8s %9.1f MB/s  %zu tokens\n", scanner,
+                bytes / elapsed.count() / (1024 * 1024), tokens * size / bytes);
+    }
+    setScanImplementation(defaultScanner);
+    resetLexer();
+}
+
 int main(int argc, char* argv[]) {
     // Read CLI args and set relevant data
     int argType = 0;
     std::vector<char*> filepaths;
     std::vector<char*> outputs;
     uint optimizationLevel = 2;
+    bool lazyCompile = false;
+    bool tieredCompile = false;
+    uint64_t tierThreshold = 1000;
+    unsigned jitThreads = 0;
+    bool jitLink = false;
+    bool slabAllocator = false;
+    std::string cacheDir;
+    bool nativeCPU = false;
+    bool debugMode = false;
+    bool batchMode = false;
+    bool useInterpreter = false;
+    bool lexBench = false;
+    std::string targetCPU;
+    std::string targetAttrs;
     for (int i = 1; i < argc; i++){
         char* arg = argv[i];
         if (strcmp(arg, "-o") == 0){
@@ -104,6 +170,70 @@ int main(int argc, char* argv[]) {
             optimizationLevel = 2;
             continue;
         }
+        else if (strcmp(arg, "-lazy") == 0){
+            lazyCompile = true;
+            continue;
+        }
+        else if (strcmp(arg, "-tiered") == 0){
+            tieredCompile = true;
+            continue;
+        }
+        else if (strncmp(arg, "-tier-threshold=", 16) == 0){
+            tierThreshold = strtoull(arg + 16, nullptr, 10);
+            continue;
+        }
+        else if (strcmp(arg, "-jitlink") == 0){
+            jitLink = true;
+            continue;
+        }
+        else if (strcmp(arg, "-jit-slab") == 0){
+            slabAllocator = true;
+            continue;
+        }
+        else if (strncmp(arg, "-jit-threads=", 13) == 0){
+            jitThreads = strtoul(arg + 13, nullptr, 10);
+            continue;
+        }
+        else if (strcmp(arg, "-interp") == 0){
+            useInterpreter = true;
+            continue;
+        }
+        else if (strcmp(arg, "-batch") == 0){
+            batchMode = true;
+            continue;
+        }
+        else if (strcmp(arg, "-debug") == 0){
+            debugMode = true;
+            continue;
+        }
+        else if (strcmp(arg, "-march=native") == 0){
+            nativeCPU = true;
+            continue;
+        }
+        else if (strncmp(arg, "-mcpu=", 6) == 0){
+            targetCPU = arg + 6;
+            continue;
+        }
+        else if (strncmp(arg, "-mattr=", 7) == 0){
+            targetAttrs = arg + 7;
+            continue;
+        }
+        else if (strcmp(arg, "-lex-bench") == 0){
+            lexBench = true;
+            continue;
+        }
+        else if (strcmp(arg, "-pretokenize") == 0){
+            setPretokenize(true);
+            continue;
+        }
+        else if (strncmp(arg, "-lex-threads=", 13) == 0){
+            setLexThreads(strtoul(arg + 13, nullptr, 10));
+            continue;
+        }
+        else if (strncmp(arg, "-cache-dir=", 11) == 0){
+            cacheDir = arg + 11;
+            continue;
+        }
 
         if (argType == 0){
             filepaths.push_back(arg);
@@ -113,9 +243,26 @@ int main(int argc, char* argv[]) {
     }
 
     SetLevel(optimizationLevel);
+    CG::SetLazyCompile(lazyCompile);
+    CG::SetJITThreads(jitThreads);
+    CG::SetJITLink(jitLink);
+    CG::SetSlabAllocator(slabAllocator);
+    CG::SetObjectCacheDir(cacheDir);
+    CG::SetTargetCPU(nativeCPU, targetCPU, targetAttrs);
+    CG::SetDebugMode(debugMode);
+    CG::SetBatchMode(batchMode);
+    CG::SetInterpreter(useInterpreter);
+
+    if (lexBench) {
+        for (char* filepath : filepaths)
+            benchLexer(filepath);
+        return 0;
+    }
 
     // Run the main "interpreter loop" now.
     if (filepaths.size() == 0) {
+        // Tiering only applies to the JIT, files are always fully optimized
+        CG::SetTieredCompile(tieredCompile, tierThreshold);
         MainLoop();
     }
     if (filepaths.size() == outputs.size() && filepaths.size() > 0){
@@ -7,276 +7,221 @@ namespace llvm {
     class BasicBlock;
     class Function;
 }
+namespace Interp {
+    class Compiler;
+    struct Chunk;
+}
 
 #include "datatype.h"
+#include "symbols.h"
 #include <cstdint>
+#include <cstring>
 #include <memory>
 #include <string>
 #include <vector>
 
 namespace AST { 
 
-/// ExprAST - Base class for all expression nodes
-class ExprAST { //To add types other than doubles, this would have a type field
-    DataType dtype;
-public:
-    virtual ~ExprAST() = default;
-    virtual llvm::Value *codegen() = 0;
-    const DataType &getDatatype() const { return dtype; };
-protected:
-    ExprAST(DataType dtype): dtype(dtype) {};
+/// NodeKind - What a node in a Tree is. The fields of Node each kind uses:
+///   node_number   Literal of any type. A/B hold the low/high half of its
+///                 bits, doubles and floats are stored as a double.
+///   node_variable A: name.
+///   node_line     A: expression, Flags: 1 if the line returns its value.
+///   node_binary   A: operator, B: LHS, C: RHS, Flags: the type both sides
+///                 are expanded to before a built in operator is applied.
+///   node_unary    A: operator, B: operand.
+///   node_call     A: callee, B: list of arguments.
+///   node_block    A: list of lines.
+///   node_flee     A: value or NoNode, Flags: depth.
+///   node_if       A: condition, B: then line, C: else line or NoNode.
+///   node_for      A: variable name, Flags: its type, B: extra holding start,
+///                 end, step and body.
+///   node_while    A: condition, B: body.
+///   node_var      A: list of name, initializer pairs. Initializers after
+///                 the first may be NoNode.
+enum NodeKind : uint8_t {
+    node_none = 0,
+    node_number,
+    node_variable,
+    node_line,
+    node_binary,
+    node_unary,
+    node_call,
+    node_block,
+    node_flee,
+    node_if,
+    node_for,
+    node_while,
+    node_var,
 };
 
-class LineAST : public ExprAST {
-    std::unique_ptr<ExprAST> Body;
-    bool returns;
-
-public:
-    LineAST(std::unique_ptr<ExprAST> Body, bool returns)
-        : Body(std::move(Body)), returns(returns), ExprAST(Body->getDatatype()) {}
-    llvm::Value *codegen() override;
-    const bool &getReturns() const {
-        return returns;
+/// NodeRef - Index of a node in its Tree.
+typedef uint32_t NodeRef;
+/// NoNode - Stands in for a missing child, and for a failed parse.
+const NodeRef NoNode = 0;
+
+/// Node - One expression. Children are referred to by index, and anything
+/// that does not fit in A, B and C lives in the extra array of the Tree.
+struct Node {
+    NodeKind Kind;
+    DataType Type;
+    uint16_t Flags;
+    uint32_t A, B, C;
+
+    uint64_t bits() const { return A | (uint64_t)B << 32; }
+    double real() const {
+        uint64_t Bits = bits();
+        double Val;
+        std::memcpy(&Val, &Bits, sizeof(Val));
+        return Val;
     }
 };
+static_assert(sizeof(Node) == 16, "Node should stay small");
 
-/// DoubleExprAST - Expression class for numeric literals like "1.0".
-class DoubleExprAST : public ExprAST {
-    double Val;
-
-public:
-    DoubleExprAST(double Val) : Val(Val), ExprAST(type_double) {}
-    llvm::Value *codegen() override;
-};
-
-/// FloatExprAST - Expression class for numeric literals like "1.0".
-class FloatExprAST : public ExprAST {
-    float Val;
-
-public:
-    FloatExprAST(double Val) : Val(Val), ExprAST(type_float) {}
-    llvm::Value *codegen() override;
-};
-
-/// I64ExprAST - Expression class for 32 bit integers
-class I64ExprAST : public ExprAST {
-    int64_t Val;
-
-public:
-    I64ExprAST(int64_t Val) : Val(Val), ExprAST(type_i64) {}
-    llvm::Value *codegen() override;
-};
-
-/// I32ExprAST - Expression class for 32 bit integers
-class I32ExprAST : public ExprAST {
-    int32_t Val;
-
-public:
-    I32ExprAST(int32_t Val) : Val(Val), ExprAST(type_i32) {}
-    llvm::Value *codegen() override;
-};
-
-/// I16ExprAST - Expression class for 16 bit integers
-class I16ExprAST : public ExprAST {
-    int16_t Val;
-
-public:
-    I16ExprAST(int16_t Val) : Val(Val), ExprAST(type_i16) {}
-    llvm::Value *codegen() override;
-};
-
-/// I8ExprAST - Expression class for 8 bit integers
-class I8ExprAST : public ExprAST {
-    int8_t Val;
+/// NodeList - A run of node references, or other values, in a Tree.
+class NodeList {
+    const uint32_t *Items;
+    uint32_t Count;
 
 public:
-    I8ExprAST(int8_t Val) : Val(Val), ExprAST(type_i8) {}
-    llvm::Value *codegen() override;
+    NodeList(const uint32_t *Items, uint32_t Count) : Items(Items), Count(Count) {}
+    uint32_t size() const { return Count; }
+    uint32_t operator[](uint32_t i) const { return Items[i]; }
+    const uint32_t *begin() const { return Items; }
+    const uint32_t *end() const { return Items + Count; }
 };
 
-/// U64ExprAST - Expression class for 32 bit unsigned integers
-class U64ExprAST : public ExprAST {
-    uint64_t Val;
-
-public:
-    U64ExprAST(uint64_t Val) : Val(Val), ExprAST(type_u64) {}
-    llvm::Value *codegen() override;
-};
-
-/// U32ExprAST - Expression class for 32 bit unsigned integers
-class U32ExprAST : public ExprAST {
-    uint32_t Val;
-
-public:
-    U32ExprAST(uint32_t Val) : Val(Val), ExprAST(type_u32) {}
-    llvm::Value *codegen() override;
-};
-
-/// U16ExprAST - Expression class for 16 bit unsigned integers
-class U16ExprAST : public ExprAST {
-    uint16_t Val;
-
-public:
-    U16ExprAST(uint16_t Val) : Val(Val), ExprAST(type_u16) {}
-    llvm::Value *codegen() override;
-};
-
-/// U8ExprAST - Expression class for 8 bit unsigned integers
-class U8ExprAST : public ExprAST {
-    uint8_t Val;
-
-public:
-    U8ExprAST(uint8_t Val) : Val(Val), ExprAST(type_u8) {}
-    llvm::Value *codegen() override;
-};
-
-/// BoolExprAST - Expression class for bools
-class BoolExprAST : public ExprAST {
-    bool Val;
-
-public:
-    BoolExprAST(bool Val) : Val(Val), ExprAST(type_bool) {}
-    llvm::Value *codegen() override;
-};
-
-/// VariableExprAST - Expression class for referencing a variable, like "a"
-class VariableExprAST : public ExprAST {
-    std::string Name;
-
-public:
-    VariableExprAST(const std::string &Name, DataType dtype) : Name(Name), ExprAST(dtype) {}
-    llvm::Value *codegen() override;
-    const std::string &getName() const {
-        return Name;
+/// Tree - The body of one function. All of its nodes are in one vector, so
+/// walking it stays within a few cache lines, and passes over it dispatch
+/// with a switch on the kind instead of virtual calls.
+class Tree {
+    std::vector<Node> Nodes;
+    std::vector<uint32_t> Extra;
+
+    NodeRef add(NodeKind Kind, DataType Type, uint16_t Flags,
+                uint32_t A = 0, uint32_t B = 0, uint32_t C = 0) {
+        Nodes.push_back({Kind, Type, Flags, A, B, C});
+        return Nodes.size() - 1;
+    }
+    uint32_t addList(const uint32_t *Items, size_t Count) {
+        uint32_t At = Extra.size();
+        Extra.push_back(Count);
+        Extra.insert(Extra.end(), Items, Items + Count);
+        return At;
     }
-};
-
-/// BinaryExprAST - Expression class for a binary operator.
-class BinaryExprAST : public ExprAST {
-    int Op;
-    std::unique_ptr<ExprAST> LHS, RHS;
-
-public:
-    BinaryExprAST(int Op, std::unique_ptr<ExprAST> LHS,
-                  std::unique_ptr<ExprAST> RHS, DataType dtype)
-        : Op(Op), LHS(std::move(LHS)), RHS(std::move(RHS)), ExprAST(dtype) {}
-    llvm::Value *codegen() override;
-};
-
-/// UnaryExprAST - Expression class for a binary operator.
-class UnaryExprAST : public ExprAST {
-    int Opcode;
-    std::unique_ptr<ExprAST> Operand;
-
-public:
-    UnaryExprAST(int Opcode, std::unique_ptr<ExprAST> Operand, DataType dtype)
-        : Opcode(Opcode), Operand(std::move(Operand)), ExprAST(dtype) {}
-    llvm::Value *codegen() override;
-};
-
-/// CallExprAST - Expression class for function calls.
-class CallExprAST : public ExprAST {
-    std::string Callee;
-    std::vector<std::unique_ptr<ExprAST>> Args;
-
-public:
-    CallExprAST(const std::string &Callee,
-                std::vector<std::unique_ptr<ExprAST>> Args, DataType dtype)
-        : Callee(Callee), Args(std::move(Args)), ExprAST(dtype) {}
-    llvm::Value *codegen() override;
-};
-
-class BlockAST : public ExprAST {
-    std::vector<std::unique_ptr<LineAST>> Lines;
-
-public:
-    std::vector<llvm::AllocaInst *> LocalVarAlloca;
-    std::vector<std::pair<llvm::BasicBlock*, llvm::Value*>> ReturnFromPoints;
-    std::vector<std::pair<std::string, std::unique_ptr<ExprAST>>> VarNames;
-    bool fleeFrom = false;
-    BlockAST(std::vector<std::unique_ptr<LineAST>> Lines, DataType dtype)
-        : Lines(std::move(Lines)), ExprAST(dtype) {}
-    llvm::Value *codegen() override;
-};
-
-class FleeAST : public ExprAST {
-    std::unique_ptr<ExprAST> Body;
-    int Depth;
-public:
-    FleeAST(std::unique_ptr<ExprAST> Body, int Depth) :
-        Body(std::move(Body)), Depth(Depth), ExprAST(type_void) {}
-    llvm::Value *codegen() override;
-};
-
-class IfExprAST : public ExprAST {
-    std::unique_ptr<ExprAST> Cond;
-    std::unique_ptr<LineAST> Then, Else;
-
-public:
-    IfExprAST(std::unique_ptr<ExprAST> Cond, std::unique_ptr<LineAST> Then,
-              std::unique_ptr<LineAST> Else)
-        : Cond(std::move(Cond)), Then(std::move(Then)), Else(std::move(Else)),
-          ExprAST(type_void) {}
-    llvm::Value *codegen() override;
-};
-
-class ForExprAST : public ExprAST {
-    std::string VarName;
-    DataType VarType;
-    std::unique_ptr<ExprAST> Start, End, Step, Body;
-
-public:
-    ForExprAST(const std::string &VarName, DataType VarType, std::unique_ptr<ExprAST> Start,
-               std::unique_ptr<ExprAST> End, std::unique_ptr<ExprAST> Step,
-               std::unique_ptr<ExprAST> Body)
-        : VarName(VarName), VarType(VarType), Start(std::move(Start)), End(std::move(End)),
-          Step(std::move(Step)), Body(std::move(Body)), ExprAST(type_void) {}
-
-    llvm::Value *codegen() override;
-};
 
-class WhileExprAST : public ExprAST {
-    std::unique_ptr<ExprAST> Condition, Body;
+    llvm::Value *codegenNumber(const Node &N) const;
+    llvm::Value *codegenVariable(const Node &N) const;
+    llvm::Value *codegenLine(const Node &N) const;
+    llvm::Value *codegenBinary(const Node &N) const;
+    llvm::Value *codegenUnary(const Node &N) const;
+    llvm::Value *codegenCall(const Node &N) const;
+    llvm::Value *codegenBlock(const Node &N) const;
+    llvm::Value *codegenFlee(const Node &N) const;
+    llvm::Value *codegenIf(const Node &N) const;
+    llvm::Value *codegenFor(const Node &N) const;
+    llvm::Value *codegenWhile(const Node &N) const;
+    llvm::Value *codegenVar(const Node &N) const;
 
 public:
-    WhileExprAST(std::unique_ptr<ExprAST> Condition, std::unique_ptr<ExprAST> Body)
-        : Condition(std::move(Condition)), Body(std::move(Body)), ExprAST(type_void) {}
-
-    llvm::Value *codegen() override;
-};
+    Tree() {
+        // Enough for most definitions without growing
+        Nodes.reserve(64);
+        Extra.reserve(32);
+        // Index 0 is taken by a placeholder, so that NoNode is never a real node
+        Nodes.push_back({node_none, type_void, 0, 0, 0, 0});
+    }
 
-class VarExprAST : public ExprAST {
-    std::vector<std::pair<std::string, std::unique_ptr<ExprAST>>> VarNames;
+    const Node &operator[](NodeRef N) const { return Nodes[N]; }
+    size_t size() const { return Nodes.size(); }
+    /// list - The list stored at At in the extra array.
+    NodeList list(uint32_t At) const { return NodeList(&Extra[At + 1], Extra[At]); }
+    /// extra - Fixed size data stored at At in the extra array.
+    const uint32_t *extra(uint32_t At) const { return &Extra[At]; }
 
-public:
-    VarExprAST(std::vector<std::pair<std::string, std::unique_ptr<ExprAST>>> VarNames, DataType dtype)
-        : VarNames(std::move(VarNames)), ExprAST(dtype) {}
+    NodeRef integer(DataType Type, uint64_t Bits) {
+        return add(node_number, Type, 0, (uint32_t)Bits, Bits >> 32);
+    }
+    NodeRef real(DataType Type, double Val) {
+        uint64_t Bits;
+        std::memcpy(&Bits, &Val, sizeof(Bits));
+        return integer(Type, Bits);
+    }
+    NodeRef variable(Symbol Name, DataType Type) {
+        return add(node_variable, Type, 0, Name);
+    }
+    NodeRef line(NodeRef Body, bool Returns) {
+        return add(node_line, Nodes[Body].Type, Returns, Body);
+    }
+    NodeRef binary(int Op, NodeRef LHS, NodeRef RHS, DataType Type, DataType Expanded) {
+        return add(node_binary, Type, Expanded, Op, LHS, RHS);
+    }
+    NodeRef unary(int Op, NodeRef Operand, DataType Type) {
+        return add(node_unary, Type, 0, Op, Operand);
+    }
+    NodeRef call(Symbol Callee, const std::vector<NodeRef> &Args, DataType Type) {
+        return add(node_call, Type, 0, Callee, addList(Args.data(), Args.size()));
+    }
+    NodeRef block(const std::vector<NodeRef> &Lines, DataType Type) {
+        return add(node_block, Type, 0, addList(Lines.data(), Lines.size()));
+    }
+    NodeRef flee(NodeRef Body, int Depth) {
+        return add(node_flee, type_void, Depth, Body);
+    }
+    NodeRef ifExpr(NodeRef Cond, NodeRef Then, NodeRef Else) {
+        return add(node_if, type_void, 0, Cond, Then, Else);
+    }
+    NodeRef forExpr(Symbol VarName, DataType VarType, NodeRef Start,
+                    NodeRef End, NodeRef Step, NodeRef Body) {
+        uint32_t At = Extra.size();
+        Extra.insert(Extra.end(), {Start, End, Step, Body});
+        return add(node_for, type_void, VarType, VarName, At);
+    }
+    NodeRef whileExpr(NodeRef Cond, NodeRef Body) {
+        return add(node_while, type_void, 0, Cond, Body);
+    }
+    NodeRef var(const std::vector<std::pair<Symbol, NodeRef>> &Vars, DataType Type) {
+        std::vector<uint32_t> Items;
+        for (auto &Var : Vars) {
+            Items.push_back(Var.first);
+            Items.push_back(Var.second);
+        }
+        return add(node_var, Type, 0, addList(Items.data(), Items.size()));
+    }
 
-    llvm::Value *codegen() override;
+    /// codegen - Emit IR for node N at the current insert point.
+    llvm::Value *codegen(NodeRef N) const;
+    /// bytecode - Compile node N into C, returning the register that holds
+    /// the result, or -1 if the interpreter does not support it.
+    int bytecode(Interp::Compiler &C, NodeRef N) const;
 };
 
 /// PrototypeAST - This class represents the "prototype" for a function,
 /// which captures its name, and its argument names (thus implicitly the number
 /// of arguments the function takes).
 class PrototypeAST {
-    std::string Name;
+    Symbol Name;
     DataType ReturnType;
-    std::vector<std::pair<std::string, DataType>> Args;
+    std::vector<std::pair<Symbol, DataType>> Args;
     bool IsOperator;
     unsigned Precedence; //Precedence if a binary op.
 
 public:
-    PrototypeAST(const std::string &Name, std::vector<std::pair<std::string, DataType>> Args,
+    PrototypeAST(Symbol Name, std::vector<std::pair<Symbol, DataType>> Args,
                  DataType returnType, bool IsOperator = false, unsigned Prec = 0,
                  int OperatorName = 0)
         : Name(Name), Args(std::move(Args)), IsOperator(IsOperator),
           Precedence(Prec), ReturnType(returnType) {}
 
     llvm::Function *codegen();
-    const std::string &getName() const {
+    Symbol getName() const {
         return Name;
     }
 
+    const std::vector<std::pair<Symbol, DataType>> &getArgs() const {
+        return Args;
+    }
+
     bool isUnaryOp() const {
         return IsOperator && Args.size() == 1;
     }
@@ -305,13 +250,16 @@ public:
 // FunctionAST - This class represents a function definition itself
 class FunctionAST {
     std::unique_ptr<PrototypeAST> Proto;
-    std::unique_ptr<ExprAST> Body;
+    Tree Nodes;
+    NodeRef Body;
 
 public:
-    FunctionAST(std::unique_ptr<PrototypeAST> Proto,
-                std::unique_ptr<ExprAST> Body)
-        : Proto(std::move(Proto)), Body(std::move(Body)) {}
+    FunctionAST(std::unique_ptr<PrototypeAST> Proto, Tree Nodes, NodeRef Body)
+        : Proto(std::move(Proto)), Nodes(std::move(Nodes)), Body(Body) {}
     llvm::Function *codegen();
+    /// bytecode - Compile the body for the interpreter. Returns false if any
+    /// part of it is not supported.
+    bool bytecode(Interp::Chunk &Out);
 
     DataType getDataType() const {
         return Proto->getDataType();
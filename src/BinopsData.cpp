@@ -2,117 +2,119 @@
 #include "./lexer.h"
 #include "datatype.h"
 
-std::vector<int> longops;
-std::map<int, BinopProperty> BinopProperties;
-std::map<int, std::map<DataType, DataType>> UnopProperties;
-const DataType priorities[] = {type_u64, type_i64, type_double, type_u32, type_i32,
-    type_float, type_u16, type_i16, type_u8, type_i8, type_bool};
-const int numPriorities = 10;
+OperatorTrie longops;
+OperatorTable<BinopProperty> BinopProperties;
+OperatorTable<UnopProperty> UnopProperties;
 
-void InitializeBinopPrecedence() {
-    // Install standard binary operators.
-    // 1 is lowest precedence.
-    BinopProperties['='] =
-        {10, std::map<std::pair<DataType, DataType>, DataType>()};
-    BinopProperties['|'] =
-        {20, std::map<std::pair<DataType, DataType>, DataType>()}; 
-    BinopProperties[optok("||")] = 
-        {20, std::map<std::pair<DataType, DataType>, DataType>()};
-    BinopProperties['&'] =
-        {30, std::map<std::pair<DataType, DataType>, DataType>()};
-    BinopProperties['>'] =
-        {40, std::map<std::pair<DataType, DataType>, DataType>()};
-    BinopProperties['<'] =
-        {40, std::map<std::pair<DataType, DataType>, DataType>()};
-    BinopProperties[optok("==")] = 
-        {40, std::map<std::pair<DataType, DataType>, DataType>()};
-    BinopProperties[optok("!=")] = 
-        {40, std::map<std::pair<DataType, DataType>, DataType>()};
-    BinopProperties[optok(">=")] =
-        {40, std::map<std::pair<DataType, DataType>, DataType>()};
-    BinopProperties[optok("<=")] =
-        {40, std::map<std::pair<DataType, DataType>, DataType>()};
-    BinopProperties['+'] =
-        {50, std::map<std::pair<DataType, DataType>, DataType>()};
-    BinopProperties['-'] =
-        {50, std::map<std::pair<DataType, DataType>, DataType>()};
-    BinopProperties['*'] =
-        {60, std::map<std::pair<DataType, DataType>, DataType>()};
-    BinopProperties['/'] =
-        {60, std::map<std::pair<DataType, DataType>, DataType>()};
-    BinopProperties['%'] =
-        {60, std::map<std::pair<DataType, DataType>, DataType>()};
+int OperatorTrie::add(const std::string &Op) {
+    int N = 0;
+    for (char c : Op) {
+        int Child = Nodes[N].Next[c - First];
+        if (!Child) {
+            // Growing Nodes can move it, so don't hold a reference across it
+            Child = Nodes.size();
+            Nodes[N].Next[c - First] = Child;
+            Nodes.emplace_back();
+        }
+        N = Child;
+    }
+    if (!Nodes[N].Op) {
+        Nodes[N].Op = optok(Op);
+        Count++;
+    }
+    return Nodes[N].Op;
+}
 
+/// ChartKind - How a built in binary operator types its operands.
+enum ChartKind {
+    chart_assign,  // Stores into the wider left hand side
+    chart_bitwise, // Integers only, gives the expanded type
+    chart_arith,   // Gives the expanded type
+    chart_compare, // Gives a bool
+};
+
+/// makeChart - Type chart of a built in binary operator. Types that would
+/// lose data when expanded can not be mixed.
+static constexpr TypeChart makeChart(ChartKind Kind) {
+    TypeChart Chart = emptyChart();
     for(int i = 0; i <= numPriorities; i++){
         DataType Bigger = priorities[i];
         for (int j = i; j <= numPriorities; j++){
             DataType Smaller = priorities[j];
-            std::pair<DataType, DataType> pair1 = std::make_pair(Bigger, Smaller);
-            std::pair<DataType, DataType> pair2 = std::make_pair(Smaller, Bigger);
-
             DataType expanded = getExpandType(Bigger, Smaller);
-            // Print the possible datatype pairs
-            //std::cout << dtypeToString(Bigger) + " and " + dtypeToString(Smaller) +
-            //    " becomes " + dtypeToString(expanded) +"\n";
-            
-            // Type will be UNDECIDED when data is lost
-            if (expanded == type_UNDECIDED){
+            if (expanded == type_UNDECIDED)
                 continue;
-            }
-
-            BinopProperties['='].CompatibilityChart[pair1] = Bigger;
-
-            if(!(isFP(Bigger) || isFP(Smaller)) ) {
-                // If not a floating point operator, install operators
-                BinopProperties['|'].CompatibilityChart[pair1] = expanded;
-                BinopProperties['|'].CompatibilityChart[pair2] = expanded;
-                BinopProperties[optok("||")].CompatibilityChart[pair1] = expanded;
-                BinopProperties[optok("||")].CompatibilityChart[pair2] = expanded;
-                BinopProperties['&'].CompatibilityChart[pair1] = expanded;
-                BinopProperties['&'].CompatibilityChart[pair2] = expanded;
-            } 
-
-            BinopProperties[optok("==")].CompatibilityChart[pair1] = type_bool;
-            BinopProperties[optok("==")].CompatibilityChart[pair2] = type_bool;
-            BinopProperties[optok("!=")].CompatibilityChart[pair1] = type_bool;
-            BinopProperties[optok("!=")].CompatibilityChart[pair2] = type_bool;
-            BinopProperties['+'].CompatibilityChart[pair1] = expanded;
-            BinopProperties['+'].CompatibilityChart[pair2] = expanded;
-            BinopProperties['-'].CompatibilityChart[pair1] = expanded;
-            BinopProperties['-'].CompatibilityChart[pair2] = expanded;
-            BinopProperties['*'].CompatibilityChart[pair1] = expanded;
-            BinopProperties['*'].CompatibilityChart[pair2] = expanded;
-            BinopProperties['/'].CompatibilityChart[pair1] = expanded;
-            BinopProperties['/'].CompatibilityChart[pair2] = expanded;
-            BinopProperties['%'].CompatibilityChart[pair1] = expanded;
-            BinopProperties['%'].CompatibilityChart[pair2] = expanded;
 
-            BinopProperties['>'].CompatibilityChart[pair1] = type_bool;
-            BinopProperties['>'].CompatibilityChart[pair2] = type_bool;
-            BinopProperties['<'].CompatibilityChart[pair1] = type_bool;
-            BinopProperties['<'].CompatibilityChart[pair2] = type_bool;
-            BinopProperties[optok(">=")].CompatibilityChart[pair1] = type_bool;
-            BinopProperties[optok(">=")].CompatibilityChart[pair2] = type_bool;
-            BinopProperties[optok("<=")].CompatibilityChart[pair1] = type_bool;
-            BinopProperties[optok("<=")].CompatibilityChart[pair2] = type_bool;
+            switch (Kind) {
+            case chart_assign:
+                Chart[Bigger][Smaller] = Bigger;
+                break;
+            case chart_bitwise:
+                if (isFP(Bigger) || isFP(Smaller))
+                    break;
+                Chart[Bigger][Smaller] = expanded;
+                Chart[Smaller][Bigger] = expanded;
+                break;
+            case chart_arith:
+                Chart[Bigger][Smaller] = expanded;
+                Chart[Smaller][Bigger] = expanded;
+                break;
+            case chart_compare:
+                Chart[Bigger][Smaller] = type_bool;
+                Chart[Smaller][Bigger] = type_bool;
+                break;
+            }
         }
     }
-    std::pair<DataType, DataType> boolop = std::make_pair(type_bool, type_bool);
-
-    longops.push_back(optok("||"));
-    longops.push_back(optok("=="));
-    longops.push_back(optok("!="));
-    longops.push_back(optok(">="));
-    longops.push_back(optok("<="));
+    return Chart;
+}
 
-    UnopProperties['!'] = std::map<DataType, DataType>();
-    UnopProperties['-'] = std::map<DataType, DataType>();
+/// makeUnopRow - Types the built in unary operator Op takes. '-' takes any
+/// number, '!' bools and unsigned integers.
+static constexpr TypeRow makeUnopRow(char Op) {
+    TypeRow Row = emptyRow();
     for(int i = 0; i <= numPriorities; i++){
-        if (priorities[i] != type_bool){
-            UnopProperties['-'][priorities[i]] = priorities[i];
-        }
-        if (!isFP(priorities[i]) && !isSigned(priorities[i])){
-            UnopProperties['!'][priorities[i]] = priorities[i];
-        }
+        DataType dtype = priorities[i];
+        if (Op == '-' && dtype != type_bool)
+            Row[dtype] = dtype;
+        if (Op == '!' && !isFP(dtype) && !isSigned(dtype))
+            Row[dtype] = dtype;
     }
+    return Row;
+}
+
+static constexpr TypeChart AssignChart = makeChart(chart_assign);
+static constexpr TypeChart BitwiseChart = makeChart(chart_bitwise);
+static constexpr TypeChart ArithChart = makeChart(chart_arith);
+static constexpr TypeChart CompareChart = makeChart(chart_compare);
+static constexpr TypeRow NegRow = makeUnopRow('-');
+static constexpr TypeRow NotRow = makeUnopRow('!');
+
+void InitializeBinopPrecedence() {
+    // Install standard binary operators.
+    // 1 is lowest precedence.
+    BinopProperties.add('=', {10, AssignChart});
+    BinopProperties.add('|', {20, BitwiseChart});
+    BinopProperties.add(optok("||"), {20, BitwiseChart});
+    BinopProperties.add('&', {30, BitwiseChart});
+    BinopProperties.add('>', {40, CompareChart});
+    BinopProperties.add('<', {40, CompareChart});
+    BinopProperties.add(optok("=="), {40, CompareChart});
+    BinopProperties.add(optok("!="), {40, CompareChart});
+    BinopProperties.add(optok(">="), {40, CompareChart});
+    BinopProperties.add(optok("<="), {40, CompareChart});
+    BinopProperties.add('+', {50, ArithChart});
+    BinopProperties.add('-', {50, ArithChart});
+    BinopProperties.add('*', {60, ArithChart});
+    BinopProperties.add('/', {60, ArithChart});
+    BinopProperties.add('%', {60, ArithChart});
+
+    longops.add("||");
+    longops.add("==");
+    longops.add("!=");
+    longops.add(">=");
+    longops.add("<=");
+
+    UnopProperties.add('!', {NotRow});
+    UnopProperties.add('-', {NegRow});
 }
@@ -1,21 +1,147 @@
 #ifndef BINOP
 #define BINOP
 #include "datatype.h"
-#include <map>
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
-/// BinopProperties - This holds the precedence for each binary operator that is
-/// defined.
+/// TypeRow - The result type of an operator for each operand type, or
+/// type_UNDECIDED where the operator does not take that type.
+typedef std::array<DataType, numTypes> TypeRow;
+/// TypeChart - The result type for each pair of left and right operand types.
+typedef std::array<TypeRow, numTypes> TypeChart;
+
+constexpr TypeRow emptyRow() {
+    TypeRow Row{};
+    for (auto &T : Row)
+        T = type_UNDECIDED;
+    return Row;
+}
+constexpr TypeChart emptyChart() {
+    TypeChart Chart{};
+    for (auto &Row : Chart)
+        Row = emptyRow();
+    return Chart;
+}
+
+/// BinopProperty - The precedence of a binary operator, and what it returns
+/// for each pair of operand types.
 struct BinopProperty{
     int Precedence;
-    std::map<std::pair<DataType, DataType>, DataType> CompatibilityChart;
+    TypeChart CompatibilityChart;
+
+    DataType result(DataType LHS, DataType RHS) const {
+        if (LHS >= numTypes || RHS >= numTypes)
+            return type_UNDECIDED;
+        return CompatibilityChart[LHS][RHS];
+    }
+};
+
+/// UnopProperty - What a unary operator returns for each operand type.
+struct UnopProperty{
+    TypeRow Types;
+
+    DataType result(DataType Operand) const {
+        if (Operand >= numTypes)
+            return type_UNDECIDED;
+        return Types[Operand];
+    }
+};
+
+/// OperatorTable - Properties of each defined operator, stored densely.
+/// Single character operators find their slot by indexing with the token,
+/// longer ones with a scan of the few that exist.
+template <typename T>
+class OperatorTable {
+    int16_t ShortSlots[256];
+    std::vector<std::pair<int, int>> LongSlots;
+    std::vector<T> Slots;
+
+    int slot(int Tok) const {
+        if (Tok >= 0 && Tok < 256)
+            return ShortSlots[Tok];
+        for (auto &Long : LongSlots)
+            if (Long.first == Tok)
+                return Long.second;
+        return -1;
+    }
+
+public:
+    OperatorTable() {
+        std::fill(std::begin(ShortSlots), std::end(ShortSlots), -1);
+    }
+
+    /// find - The properties of the operator Tok, or null if it is not one.
+    /// The pointer is good until the next add.
+    T *find(int Tok) {
+        int Slot = slot(Tok);
+        return Slot < 0 ? nullptr : &Slots[Slot];
+    }
+
+    /// add - The properties of the operator Tok, set to Init if it is new.
+    T &add(int Tok, const T &Init) {
+        int Slot = slot(Tok);
+        if (Slot >= 0)
+            return Slots[Slot];
+        Slot = Slots.size();
+        if (Tok >= 0 && Tok < 256)
+            ShortSlots[Tok] = Slot;
+        else
+            LongSlots.push_back(std::make_pair(Tok, Slot));
+        Slots.push_back(Init);
+        return Slots.back();
+    }
+};
+
+/// OperatorTrie - Every operator longer than one character, as a trie over
+/// the printable ASCII characters, so the lexer finds the longest operator at
+/// a position in O(length).
+class OperatorTrie {
+    static const int First = '!';
+    static const int Last = '~';
+    struct Node {
+        int Op = 0; // Token of the operator ending here, 0 if none
+        int Next[Last - First + 1] = {}; // Child node, 0 if none
+    };
+    std::vector<Node> Nodes = std::vector<Node>(1);
+    size_t Count = 0;
+
+public:
+    static bool isOperatorChar(char c) { return c >= First && c <= Last; }
+
+    /// add - Install Op, and return its token.
+    int add(const std::string &Op);
+
+    /// match - The longest operator at Data[Pos], or 0. Length is set to its
+    /// length when one is found.
+    int match(std::string_view Data, size_t Pos, size_t &Length) const {
+        const Node *Trie = Nodes.data();
+        int Op = 0;
+        int N = 0;
+        for (size_t i = Pos; i < Data.size() && isOperatorChar(Data[i]); i++) {
+            N = Trie[N].Next[Data[i] - First];
+            if (!N)
+                break;
+            if (Trie[N].Op) {
+                Op = Trie[N].Op;
+                Length = i - Pos + 1;
+            }
+        }
+        return Op;
+    }
+
+    size_t size() const { return Count; }
 };
 
-extern std::map<int, BinopProperty> BinopProperties;
-extern std::map<int, std::map<DataType, DataType>> UnopProperties;
-extern std::vector<int> longops;
-extern const DataType priorities[];
-extern const int numPriorities;
+extern OperatorTable<BinopProperty> BinopProperties;
+extern OperatorTable<UnopProperty> UnopProperties;
+extern OperatorTrie longops;
 
 void InitializeBinopPrecedence();
 
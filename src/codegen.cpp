@@ -6,8 +6,14 @@
 #include "./parser.h"
 #include "./logging.h"
 #include "./codegen/optimizations.h"
+#include "./codegen/tiering.h"
+#include "./codegen/objectcache.h"
+#include "./interpreter/bytecode.h"
 #include "llvm/IR/PassManager.h"
 #include "llvm/ADT/APFloat.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Config/llvm-config.h"
 #include "../include/QuailJIT.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/DerivedTypes.h"
@@ -22,6 +28,8 @@
 #include "llvm/Passes/StandardInstrumentations.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/TargetParser/Host.h"
+#include <algorithm>
 #include <cctype>
 #include <cstdint>
 #include <cstdio>
@@ -31,8 +39,10 @@
 #include <llvm/IR/Instruction.h>
 #include <llvm/IR/Value.h>
 #include <map>
+#include <optional>
 #include <memory>
 #include <utility>
+#include <vector>
 
 namespace CG { 
 
@@ -40,60 +50,195 @@ using namespace llvm;
 using namespace llvm::orc;
 
 std::unique_ptr<Module> TheModule;
-std::map<std::string, AllocaInst*> NamedValues;
+::ScopedSymbolMap<AllocaInst*> NamedValues;
 std::unique_ptr<QuailJIT> TheJIT;
-std::map<std::string, std::unique_ptr<AST::PrototypeAST>> FunctionProtos;
+::SymbolMap<std::unique_ptr<AST::PrototypeAST>> FunctionProtos;
 ExitOnError ExitOnErr;
 std::unique_ptr<LLVMContext> TheContext;
 std::unique_ptr<IRBuilder<>> Builder;
 
 Passes passes;
 
+static QuailJITOptions JITOptions;
+void SetLazyCompile(bool lazy){
+    JITOptions.LazyCompile = lazy;
+}
+void SetTieredCompile(bool tiered, uint64_t threshold){
+    JITOptions.Tiered = tiered;
+    Tiering::SetThreshold(threshold);
+}
+void SetJITThreads(unsigned threads){
+    JITOptions.NumThreads = threads;
+}
+void SetJITLink(bool jitlink){
+    JITOptions.UseJITLink = jitlink;
+}
+void SetSlabAllocator(bool slab){
+    JITOptions.SlabAllocator = slab;
+}
+
+std::string TargetCPU = "generic";
+std::vector<std::string> TargetFeatures;
+static std::unique_ptr<TargetMachine> TheTargetMachine;
+void SetTargetCPU(bool native, std::string cpu, std::string attrs){
+    if (native) {
+        TargetCPU = sys::getHostCPUName().str();
+        StringMap<bool> HostFeatures;
+        if (sys::getHostCPUFeatures(HostFeatures)) {
+            for (auto &Feature : HostFeatures)
+                TargetFeatures.push_back((Feature.second ? "+" : "-") + Feature.first().str());
+        }
+    }
+    if (!cpu.empty())
+        TargetCPU = cpu;
+    SmallVector<StringRef, 8> Attrs;
+    StringRef(attrs).split(Attrs, ',', -1, false);
+    for (StringRef Attr : Attrs)
+        TargetFeatures.push_back(Attr.str());
+
+    JITOptions.CPU = TargetCPU;
+    JITOptions.Features = TargetFeatures;
+}
+
+std::string ObjectCacheDir;
+static std::unique_ptr<DiskObjectCache> TheObjectCache;
+void SetObjectCacheDir(std::string dir){
+    ObjectCacheDir = dir;
+}
+
+static bool DebugMode = false;
+void SetDebugMode(bool debug){
+    DebugMode = debug;
+}
+
+// Top-level expressions waiting to be run, in the order they were entered.
+// Only used in batch mode.
+static bool BatchMode = false;
+static uint64_t BatchCounter = 0;
+struct PendingExpr {
+    std::string Name;
+    DataType dtype;
+    // Set if the expression is interpreted instead of compiled
+    std::unique_ptr<Interp::Chunk> Code;
+};
+static std::vector<PendingExpr> PendingExprs;
+void SetBatchMode(bool batch){
+    BatchMode = batch;
+}
+
+static bool UseInterpreter = false;
+void SetInterpreter(bool interp){
+    UseInterpreter = interp;
+}
+
 void InitializeCodegen(){
     InitializeNativeTarget();
     InitializeNativeTargetAsmPrinter();
     InitializeNativeTargetAsmParser();
 
-    TheJIT = ExitOnErr(QuailJIT::Create());
-}
+    if (!ObjectCacheDir.empty()) {
+        // Tier 0 is compiled at a lower codegen level, so it gets its own keys
+        // Objects from another LLVM build are never loaded
+        std::string Salt = std::string("LLVM " LLVM_VERSION_STRING "\n") +
+            sys::getProcessTriple() + "\n" + TargetCPU + "\n" +
+            join(TargetFeatures, ",") + "\njit -O" + std::to_string(GetLevel());
+        if (JITOptions.Tiered)
+            Salt += " tiered";
+        TheObjectCache = std::make_unique<DiskObjectCache>(ObjectCacheDir, Salt);
+        JITOptions.ObjCache = TheObjectCache.get();
+    }
 
-void InitializeModuleAndManagers() {
-    //Open a new context and module
-    TheContext = std::make_unique<LLVMContext>();
-    TheModule = std::make_unique<Module>("QuailJIT", *TheContext);
-    TheModule->setDataLayout(TheJIT->getDataLayout());
+    if (JITOptions.SlabAllocator && JITOptions.UseJITLink) {
+        fprintf(stderr, "Warning: -jit-slab only applies to the RuntimeDyld "
+                "linker, and is ignored with -jitlink.\n");
+        JITOptions.SlabAllocator = false;
+    }
+    if (JITOptions.SlabAllocator && !SlabMemoryPool::isSupported()) {
+        fprintf(stderr, "Warning: -jit-slab needs executable shared memory, "
+                "which this system does not allow. Ignoring it.\n");
+        JITOptions.SlabAllocator = false;
+    }
 
-    //Create a builder for the module
-    Builder = std::make_unique<IRBuilder<>>(*TheContext);
+    TheJIT = ExitOnErr(QuailJIT::Create(JITOptions));
+    TheTargetMachine = ExitOnErr(TheJIT->createTargetMachine());
+}
 
-    // Create new pass and analysis manager
+// InitializePassManagers - Build the analysis managers and the optimization
+// pipeline. Outside of debug mode this only happens once per session.
+static void InitializePassManagers() {
     passes.TheFPM = std::make_unique<FunctionPassManager>();
     passes.TheLAM = std::make_unique<LoopAnalysisManager>();
     passes.TheFAM = std::make_unique<FunctionAnalysisManager>();
     passes.TheCGAM = std::make_unique<CGSCCAnalysisManager>();
     passes.TheMAM = std::make_unique<ModuleAnalysisManager>();
     passes.ThePIC = std::make_unique<PassInstrumentationCallbacks>();
-    passes.TheSI = std::make_unique<StandardInstrumentations>(*TheContext,
-            /*DebugLogging*/ true);
-    passes.TheSI->registerCallbacks(*passes.ThePIC, passes.TheMAM.get());
+    // The instrumentations hold on to the context they were made with, so in
+    // debug mode everything is rebuilt for each module.
+    passes.TheSI.reset();
+    if (DebugMode) {
+        passes.TheSI = std::make_unique<StandardInstrumentations>(*TheContext,
+                /*DebugLogging*/ true);
+        passes.TheSI->registerCallbacks(*passes.ThePIC, passes.TheMAM.get());
+    }
 
-    Optimize();
+    // Tier 0 code is left unoptimized, hot functions get the full pipeline
+    // when they are recompiled.
+    if (!JITOptions.Tiered)
+        Optimize();
 
     // Register analysis passes used in these transform passes.
-    PassBuilder PB;
+    PassBuilder PB(TheTargetMachine.get(), PipelineTuningOptions(), std::nullopt,
+            passes.ThePIC.get());
     PB.registerModuleAnalyses(*passes.TheMAM);
     PB.registerFunctionAnalyses(*passes.TheFAM);
     PB.crossRegisterProxies(*passes.TheLAM, *passes.TheFAM, *passes.TheCGAM, *passes.TheMAM);
 }
 
+void InitializeModuleAndManagers() {
+    // Open a new context and module. The context can't be shared between
+    // inputs, it moves into the JIT together with the module.
+    TheContext = std::make_unique<LLVMContext>();
+    if (!DebugMode)
+        TheContext->setDiscardValueNames(true);
+    TheModule = std::make_unique<Module>("QuailJIT", *TheContext);
+    TheModule->setDataLayout(TheJIT->getDataLayout());
+    TheModule->setTargetTriple(TheJIT->getTargetTriple().str());
+
+    //Create a builder for the module
+    Builder = std::make_unique<IRBuilder<>>(*TheContext);
+
+    if (DebugMode || !passes.TheFPM) {
+        InitializePassManagers();
+    } else {
+        // Cached results point into the last module, which is gone now.
+        passes.TheMAM->clear();
+        passes.TheCGAM->clear();
+        passes.TheFAM->clear();
+        passes.TheLAM->clear();
+    }
+}
+
 void HandleDefinitionJit() {
     if (auto FnAST = ParseDefinition()) {
         if (auto *FnIR = FnAST->codegen()) {
             fprintf(stderr, "Parsed a function definition.\n");
             FnIR->print(errs());
             fprintf(stderr, "\n");
-            ExitOnErr(TheJIT->addModule(
-                          ThreadSafeModule(std::move(TheModule), std::move(TheContext))));
+            std::string Name = FnIR->getName().str();
+            if (JITOptions.Tiered) {
+                Tiering::AddDefinition(std::move(TheModule), std::move(TheContext), Name);
+            } else {
+                ExitOnErr(TheJIT->addModule(
+                              ThreadSafeModule(std::move(TheModule), std::move(TheContext))));
+                // Compile on the thread pool now, instead of on the prompt's
+                // thread the first time the function is needed.
+                if (JITOptions.NumThreads > 0 && !JITOptions.LazyCompile)
+                    TheJIT->compileInBackground(Name);
+            }
+            if (SlabMemoryPool *Pool = TheJIT->getSlabPool()) {
+                fprintf(stderr, "JIT memory: %zu KiB mapped, %zu KiB in use\n",
+                        Pool->getMappedBytes() / 1024, Pool->getUsedBytes() / 1024);
+            }
             InitializeModuleAndManagers();
         }
     } 
@@ -120,82 +265,181 @@ void HandleExtern() {
     } 
 }
 
+// PrintValue - Print the result of a top-level expression.
+static void PrintValue(Interp::Value V, DataType dtype) {
+    if (dtype == type_double){
+        fprintf(stderr, "Evaluated to %f\n", V.D);
+    } else if (dtype == type_bool){
+        // This might be a temporary workaround, depending on if the -1 value of true is supposed to happen.
+        // First, we assume that our bool is actually an integer.
+        int8_t Bool = (int8_t)V.I;
+        // Next, we take a bitwise and of 1, essentially only checking for the 1 relevant bit.
+        if (Bool & 1)
+            fprintf(stderr, "Evaluated to True\n");
+        else
+            fprintf(stderr, "Evaluated to False\n");
+        if ((Bool & 1) != Bool)
+            fprintf(stderr, "Bad bool %i was created\n", Bool);
+        // It looks like, besides the bad display value, everything works properly with the bools being -1 or -2. 
+        // The ! operation still flips the relevant bit, and addition still adds 1 or 0, as does the other operations.
+        // The bug looks difficult to fix, so only fix if it causes real problems
+    } else if (dtype == type_float){
+        fprintf(stderr, "Evaluated to %f\n", V.F);
+    } else if (dtype == type_i8){
+        fprintf(stderr, "Evaluated to %i\n", (int8_t)V.I);
+    } else if (dtype == type_i16){
+        fprintf(stderr, "Evaluated to %i\n", (int16_t)V.I);
+    } else if (dtype == type_i32){
+        fprintf(stderr, "Evaluated to %i\n", (int32_t)V.I);
+    } else if (dtype == type_i64){
+        fprintf(stderr, "Evaluated to %ld\n", V.I);
+    } else if (dtype == type_u8){
+        fprintf(stderr, "Evaluated to %u\n", (uint8_t)V.U);
+    } else if (dtype == type_u16){
+        fprintf(stderr, "Evaluated to %u\n", (uint16_t)V.U);
+    } else if (dtype == type_u32){
+        fprintf(stderr, "Evaluated to %u\n", (uint32_t)V.U);
+    } else if (dtype == type_u64){
+        fprintf(stderr, "Evaluated to %lu\n", V.U);
+    }
+}
+
+// PrintResult - Run the top-level expression at Addr and print its value.
+static void PrintResult(ExecutorAddr Addr, DataType dtype) {
+    // Cast the address into the right type (takes no arguments, returns
+    // dtype) so we can call it as a native function.
+    Interp::Value V;
+    if (dtype == type_double){
+        V = Interp::Value::ofDouble(Addr.toPtr<double (*)()>()());
+    } else if (dtype == type_float){
+        V = Interp::Value::ofFloat(Addr.toPtr<float (*)()>()());
+    } else if (dtype == type_bool || dtype == type_i8){
+        V = Interp::Value::ofInt(Addr.toPtr<int8_t (*)()>()());
+    } else if (dtype == type_i16){
+        V = Interp::Value::ofInt(Addr.toPtr<int16_t (*)()>()());
+    } else if (dtype == type_i32){
+        V = Interp::Value::ofInt(Addr.toPtr<int32_t (*)()>()());
+    } else if (dtype == type_i64){
+        V = Interp::Value::ofInt(Addr.toPtr<int64_t (*)()>()());
+    } else if (dtype == type_u8){
+        V = Interp::Value::ofUInt(Addr.toPtr<uint8_t (*)()>()());
+    } else if (dtype == type_u16){
+        V = Interp::Value::ofUInt(Addr.toPtr<uint16_t (*)()>()());
+    } else if (dtype == type_u32){
+        V = Interp::Value::ofUInt(Addr.toPtr<uint32_t (*)()>()());
+    } else if (dtype == type_u64){
+        V = Interp::Value::ofUInt(Addr.toPtr<uint64_t (*)()>()());
+    } else if (dtype == type_void){
+        Addr.toPtr<void (*)()>()();
+        return;
+    }
+    PrintValue(V, dtype);
+}
+
 void HandleTopLevelExpression() {
+    std::string Name = "__anon_expr";
+    if (BatchMode)
+        Name += "." + std::to_string(BatchCounter++);
+
     // Evaluate a top-level expression into an anonymous function.
-    if (auto FnAST = ParseTopLevelExpr()) {
-        DataType dtype = FnAST->getDataType();
-        if (FnAST->codegen()) {
-            // Create a Resource Tracker to track JIT'd memory allocated to our
-            // anonymous expression -- that way we can free it after executing.
-            auto RT = TheJIT->getMainJITDylib().createResourceTracker();
-
-            auto TSM = ThreadSafeModule(std::move(TheModule), std::move(TheContext));
-            ExitOnErr(TheJIT->addModule(std::move(TSM), RT));
-            InitializeModuleAndManagers();
+    auto FnAST = ParseTopLevelExpr(Name);
+    if (!FnAST)
+        return;
+    DataType dtype = FnAST->getDataType();
 
-            // Search the JIT for the __anon_expr symbol.
-            auto ExprSymbol = ExitOnErr(TheJIT->lookup("__anon_expr"));
-            // Get the symbol's address and cast it into the right type (takes no
-            // arguments, returns a double) so we can call it as a native function.
-            
-            if (dtype == type_double){
-                double (*Function)() = ExprSymbol.getAddress().toPtr<double (*)()>();
-                fprintf(stderr, "Evaluated to %f\n", Function());
-            } else if (dtype == type_bool){
-                // This might be a temporary workaround, depending on if the -1 value of true is supposed to happen.
-                // First, we assume that our bool is actually an integer.
-                int8_t (*Function)() = ExprSymbol.getAddress().toPtr<int8_t (*)()>();
-                // Next, we take a bitwise and of 1, essentially only checking for the 1 relevant bit.
-                if (Function() & 1)
-                    fprintf(stderr, "Evaluated to True\n");
-                else
-                    fprintf(stderr, "Evaluated to False\n");
-                if ((Function() & 1) != Function())
-                    fprintf(stderr, "Bad bool %i was created\n", Function());
-                // It looks like, besides the bad display value, everything works properly with the bools being -1 or -2. 
-                // The ! operation still flips the relevant bit, and addition still adds 1 or 0, as does the other operations.
-                // The bug looks difficult to fix, so only fix if it causes real problems
-            } else if (dtype == type_float){
-                float (*Function)() = ExprSymbol.getAddress().toPtr<float (*)()>();
-                fprintf(stderr, "Evaluated to %f\n", Function());
-            } else if (dtype == type_i8){
-                int8_t (*Function)() = ExprSymbol.getAddress().toPtr<int8_t (*)()>();
-                fprintf(stderr, "Evaluated to %i\n", Function());
-            } else if (dtype == type_i16){
-                int16_t (*Function)() = ExprSymbol.getAddress().toPtr<int16_t (*)()>();
-                fprintf(stderr, "Evaluated to %i\n", Function());
-            } else if (dtype == type_i32){
-                int32_t (*Function)() = ExprSymbol.getAddress().toPtr<int32_t (*)()>();
-                fprintf(stderr, "Evaluated to %i\n", Function());
-            } else if (dtype == type_i64){
-                int64_t (*Function)() = ExprSymbol.getAddress().toPtr<int64_t (*)()>();
-                fprintf(stderr, "Evaluated to %ld\n", Function());
-            } else if (dtype == type_u8){
-                uint8_t (*Function)() = ExprSymbol.getAddress().toPtr<uint8_t (*)()>();
-                fprintf(stderr, "Evaluated to %u\n", Function());
-            } else if (dtype == type_u16){
-                uint16_t (*Function)() = ExprSymbol.getAddress().toPtr<uint16_t (*)()>();
-                fprintf(stderr, "Evaluated to %u\n", Function());
-            } else if (dtype == type_u32){
-                uint32_t (*Function)() = ExprSymbol.getAddress().toPtr<uint32_t (*)()>();
-                fprintf(stderr, "Evaluated to %u\n", Function());
-            } else if (dtype == type_u64){
-                uint64_t (*Function)() = ExprSymbol.getAddress().toPtr<uint64_t (*)()>();
-                fprintf(stderr, "Evaluated to %lu\n", Function());
-            } else if (dtype == type_void){
-                void (*Function)() = ExprSymbol.getAddress().toPtr<void (*)()>();
-                Function();
-            }
-            
-            // Delete the anonymous expression module from the JIT
-            ExitOnErr(RT->remove());
+    // Cheap expressions are run by the interpreter, without going through
+    // LLVM at all.
+    if (UseInterpreter) {
+        auto Code = std::make_unique<Interp::Chunk>();
+        if (FnAST->bytecode(*Code)) {
+            if (BatchMode)
+                PendingExprs.push_back({Name, dtype, std::move(Code)});
+            else
+                PrintValue(Interp::Run(*Code), dtype);
+            return;
         }
-    } 
+    }
+
+    if (!FnAST->codegen())
+        return;
+
+    if (BatchMode) {
+        // Collect the expression into the current module, it is run by
+        // FlushTopLevelExpressions together with the rest of the batch.
+        PendingExprs.push_back({Name, dtype, nullptr});
+        return;
+    }
+
+    // Create a Resource Tracker to track JIT'd memory allocated to our
+    // anonymous expression -- that way we can free it after executing.
+    auto RT = TheJIT->getMainJITDylib().createResourceTracker();
+
+    auto TSM = ThreadSafeModule(std::move(TheModule), std::move(TheContext));
+    ExitOnErr(TheJIT->addModule(std::move(TSM), RT));
+    InitializeModuleAndManagers();
+
+    // Search the JIT for the __anon_expr symbol.
+    auto ExprSymbol = ExitOnErr(TheJIT->lookup(Name));
+    PrintResult(ExprSymbol.getAddress(), dtype);
+
+    // Delete the anonymous expression module from the JIT
+    ExitOnErr(RT->remove());
+}
+
+void FlushTopLevelExpressions() {
+    if (PendingExprs.empty())
+        return;
+
+    // An expression that failed to compile can leave a partial body behind.
+    std::vector<std::string> Names;
+    for (auto &Expr : PendingExprs) {
+        if (!Expr.Code)
+            Names.push_back(Expr.Name);
+    }
+    for (Function &F : make_early_inc_range(*TheModule)) {
+        if (!F.isDeclaration() &&
+                std::find(Names.begin(), Names.end(), F.getName()) == Names.end())
+            F.eraseFromParent();
+    }
+
+    // The compiled part of the batch shares one module, one lookup and one
+    // tracker.
+    ResourceTrackerSP RT;
+    std::vector<ExecutorSymbolDef> Symbols;
+    if (!Names.empty()) {
+        RT = TheJIT->getMainJITDylib().createResourceTracker();
+        auto TSM = ThreadSafeModule(std::move(TheModule), std::move(TheContext));
+        ExitOnErr(TheJIT->addModule(std::move(TSM), RT));
+        InitializeModuleAndManagers();
+        Symbols = ExitOnErr(TheJIT->lookupAll(Names));
+    }
+
+    size_t NextSymbol = 0;
+    for (auto &Expr : PendingExprs) {
+        if (Expr.Code) {
+            PrintValue(Interp::Run(*Expr.Code), Expr.dtype);
+        } else {
+            PrintResult(Symbols[NextSymbol++].getAddress(), Expr.dtype);
+            FunctionProtos.erase(Identifiers.intern(Expr.Name));
+        }
+    }
+    PendingExprs.clear();
+
+    if (RT)
+        ExitOnErr(RT->remove());
+
+    // Nothing of this batch is left in the JIT, so the next one can reuse its
+    // names. Every name is interned for good, so only ever making new ones
+    // would grow every symbol table for the rest of the session.
+    BatchCounter = 0;
 }
 
 void CloseCodegen() {
+    Tiering::Shutdown();
     TheModule.reset(); 
+    passes = Passes();
     TheJIT.reset();
+    TheTargetMachine.reset();
     TheContext.reset();
     Builder.reset();
 }
@@ -1,14 +1,29 @@
 #ifndef CODEGEN
 #define CODEGEN
 
+#include <cstdint>
+#include <string>
+
 namespace CG {
 
+void SetLazyCompile(bool lazy);
+void SetTieredCompile(bool tiered, uint64_t threshold);
+void SetJITThreads(unsigned threads);
+void SetJITLink(bool jitlink);
+void SetSlabAllocator(bool slab);
+void SetObjectCacheDir(std::string dir);
+void SetTargetCPU(bool native, std::string cpu, std::string attrs);
+void SetDebugMode(bool debug);
+void SetBatchMode(bool batch);
+void SetInterpreter(bool interp);
+
 void InitializeCodegen();
 void InitializeModuleAndManagers();
 void HandleDefinitionJit();
 void HandleDefinitionFile();
 void HandleExtern();
 void HandleTopLevelExpression();
+void FlushTopLevelExpressions();
 
 void CloseCodegen();
 
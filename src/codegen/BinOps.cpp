@@ -51,8 +51,7 @@ Value* expandDataType(Value* input, DataType target, DataType prior){
     }
 };
 
-std::pair<Value*, Value*> expandOperation(DataType LHS, DataType RHS, Value* L, Value* R){
-    DataType retType = getExpandType(LHS, RHS);
+std::pair<Value*, Value*> expandOperation(DataType LHS, DataType RHS, DataType retType, Value* L, Value* R){
     if (retType == type_UNDECIDED){
         LogCompilerBug("Datatype expansion of type '" + dtypeToString(LHS) + "' and '" + 
                 dtypeToString(RHS) + "' results in compile-time dataloss");
@@ -66,8 +65,8 @@ std::pair<Value*, Value*> expandOperation(DataType LHS, DataType RHS, Value* L,
 /// 0: Or
 /// 1: Xor
 /// 2: And
-Value* LogicGate(DataType LHS, DataType RHS, Value* L, Value* R, int gate) {
-    std::pair<Value*, Value*> parts = expandOperation(LHS, RHS, L, R);
+Value* LogicGate(DataType LHS, DataType RHS, DataType Expanded, Value* L, Value* R, int gate) {
+    std::pair<Value*, Value*> parts = expandOperation(LHS, RHS, Expanded, L, R);
 
     if (gate == 0)
         return Builder->CreateOr(parts.first, parts.second, "ortmp");
@@ -79,10 +78,9 @@ Value* LogicGate(DataType LHS, DataType RHS, Value* L, Value* R, int gate) {
     return LogCompilerBug("Attempted to build non-existant logic gate with ID #" + std::to_string(gate));
 };
 
-Value* EqualityCheck(DataType LHS, DataType RHS, Value* L, Value* R, int Op) {
-    std::pair<Value*, Value*> parts = expandOperation(LHS, RHS, L, R);
-    DataType retType = getExpandType(LHS, RHS);
-    if (isFP(retType)){
+Value* EqualityCheck(DataType LHS, DataType RHS, DataType Expanded, Value* L, Value* R, int Op) {
+    std::pair<Value*, Value*> parts = expandOperation(LHS, RHS, Expanded, L, R);
+    if (isFP(Expanded)){
         if (Op == '<')
             return Builder->CreateFCmpULT(parts.first, parts.second, "tlttmp");
         else if (Op == '>')
@@ -96,7 +94,7 @@ Value* EqualityCheck(DataType LHS, DataType RHS, Value* L, Value* R, int Op) {
         else if (Op == op_neq)
             return Builder->CreateFCmpUNE(parts.first, parts.second, "tnetmp");
     }
-    else if (isSigned(retType)){
+    else if (isSigned(Expanded)){
         if (Op == '<')
             return Builder->CreateICmpSLT(parts.first, parts.second, "tlttmp");
         else if (Op == '>')
@@ -129,22 +127,20 @@ Value* EqualityCheck(DataType LHS, DataType RHS, Value* L, Value* R, int Op) {
     return LogCompilerBug("Attempted to compare equality with '" + tokop(Op) + "' operator.");
 };
 
-Value* Add(DataType LHS, DataType RHS, Value* L, Value* R){
-    std::pair<Value*, Value*> parts = expandOperation(LHS, RHS, L, R);
-    DataType retType = getExpandType(LHS, RHS);
+Value* Add(DataType LHS, DataType RHS, DataType Expanded, Value* L, Value* R){
+    std::pair<Value*, Value*> parts = expandOperation(LHS, RHS, Expanded, L, R);
 
-    if (isFP(retType)){
+    if (isFP(Expanded)){
         return Builder->CreateFAdd(parts.first, parts.second, "addtmp");
     }
     else{
         return Builder->CreateAdd(parts.first, parts.second, "addtmp");
     }
 };
-Value* Sub(DataType LHS, DataType RHS, Value* L, Value* R){
-    std::pair<Value*, Value*> parts = expandOperation(LHS, RHS, L, R);
-    DataType retType = getExpandType(LHS, RHS);
+Value* Sub(DataType LHS, DataType RHS, DataType Expanded, Value* L, Value* R){
+    std::pair<Value*, Value*> parts = expandOperation(LHS, RHS, Expanded, L, R);
 
-    if (isFP(retType)){
+    if (isFP(Expanded)){
         return Builder->CreateFSub(parts.first, parts.second, "subtmp");
     }
     else{
@@ -152,41 +148,38 @@ Value* Sub(DataType LHS, DataType RHS, Value* L, Value* R){
     }
 };
 
-Value* Mul(DataType LHS, DataType RHS, Value* L, Value* R){
-    std::pair<Value*, Value*> parts = expandOperation(LHS, RHS, L, R);
-    DataType retType = getExpandType(LHS, RHS);
+Value* Mul(DataType LHS, DataType RHS, DataType Expanded, Value* L, Value* R){
+    std::pair<Value*, Value*> parts = expandOperation(LHS, RHS, Expanded, L, R);
 
-    if (isFP(retType)) {
+    if (isFP(Expanded)) {
         return Builder->CreateFMul(parts.first, parts.second, "multmp");
     }
     else{
         return Builder->CreateMul(parts.first, parts.second, "multmp");
     }
 };
-Value* Div(DataType LHS, DataType RHS, Value* L, Value* R){
-    std::pair<Value*, Value*> parts = expandOperation(LHS, RHS, L, R);
-    DataType retType = getExpandType(LHS, RHS);
+Value* Div(DataType LHS, DataType RHS, DataType Expanded, Value* L, Value* R){
+    std::pair<Value*, Value*> parts = expandOperation(LHS, RHS, Expanded, L, R);
 
-    if (isFP(retType)) {
+    if (isFP(Expanded)) {
         return Builder->CreateFDiv(parts.first, parts.second, "divtmp");
     }
     else{
-        if (isSigned(retType)){
+        if (isSigned(Expanded)){
             return Builder->CreateSDiv(parts.first, parts.second, "divtmp");
         } else {
             return Builder->CreateUDiv(parts.first, parts.second, "divtmp");
         }
     }
 };
-Value* Mod(DataType LHS, DataType RHS, Value* L, Value* R){
-    std::pair<Value*, Value*> parts = expandOperation(LHS, RHS, L, R);
-    DataType retType = getExpandType(LHS, RHS);
+Value* Mod(DataType LHS, DataType RHS, DataType Expanded, Value* L, Value* R){
+    std::pair<Value*, Value*> parts = expandOperation(LHS, RHS, Expanded, L, R);
 
-    if (isFP(retType)) {
+    if (isFP(Expanded)) {
         return Builder->CreateFRem(parts.first, parts.second, "modtmp");
     }
     else{
-        if (isSigned(retType)){
+        if (isSigned(Expanded)){
             return Builder->CreateSRem(parts.first, parts.second, "modtmp");
         } else {
             return Builder->CreateURem(parts.first, parts.second, "modtmp");
@@ -9,16 +9,17 @@ namespace llvm {
 namespace CG {
 namespace BinOps {
 
-llvm::Value* LogicGate(DataType LHS, DataType RHS, llvm::Value* L, llvm::Value* R, int gate);
+// Expanded is the type both sides are converted to, see getExpandType.
+llvm::Value* LogicGate(DataType LHS, DataType RHS, DataType Expanded, llvm::Value* L, llvm::Value* R, int gate);
 
-llvm::Value* EqualityCheck(DataType LHS, DataType RHS, llvm::Value* L, llvm::Value* R, int Op);
+llvm::Value* EqualityCheck(DataType LHS, DataType RHS, DataType Expanded, llvm::Value* L, llvm::Value* R, int Op);
 
-llvm::Value* Add(DataType LHS, DataType RHS, llvm::Value* L, llvm::Value* R);
-llvm::Value* Sub(DataType LHS, DataType RHS, llvm::Value* L, llvm::Value* R);
+llvm::Value* Add(DataType LHS, DataType RHS, DataType Expanded, llvm::Value* L, llvm::Value* R);
+llvm::Value* Sub(DataType LHS, DataType RHS, DataType Expanded, llvm::Value* L, llvm::Value* R);
 
-llvm::Value* Mul(DataType LHS, DataType RHS, llvm::Value* L, llvm::Value* R);
-llvm::Value* Div(DataType LHS, DataType RHS, llvm::Value* L, llvm::Value* R);
-llvm::Value* Mod(DataType LHS, DataType RHS, llvm::Value* L, llvm::Value* R);
+llvm::Value* Mul(DataType LHS, DataType RHS, DataType Expanded, llvm::Value* L, llvm::Value* R);
+llvm::Value* Div(DataType LHS, DataType RHS, DataType Expanded, llvm::Value* L, llvm::Value* R);
+llvm::Value* Mod(DataType LHS, DataType RHS, DataType Expanded, llvm::Value* L, llvm::Value* R);
 
 llvm::Value* Neg(DataType dtype, llvm::Value* input);
 
@@ -19,23 +19,30 @@ namespace llvm {
 #include <memory>
 #include <map>
 #include <string>
+#include <vector>
 #include "../datatype.h"
+#include "../symbols.h"
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/Support/Error.h>
 
 namespace CG {
 
 extern std::unique_ptr<llvm::Module> TheModule;
-extern std::map<std::string, llvm::AllocaInst*> NamedValues;
+extern ScopedSymbolMap<llvm::AllocaInst*> NamedValues;
 extern std::unique_ptr<llvm::orc::QuailJIT> TheJIT;
-extern std::map<std::string, std::unique_ptr<AST::PrototypeAST>> FunctionProtos;
+extern SymbolMap<std::unique_ptr<AST::PrototypeAST>> FunctionProtos;
 extern llvm::ExitOnError ExitOnErr;
 extern std::unique_ptr<llvm::LLVMContext> TheContext;
 extern std::unique_ptr<llvm::IRBuilder<>> Builder;
+extern std::string ObjectCacheDir;
+extern std::string TargetCPU;
+extern std::vector<std::string> TargetFeatures;
 
 llvm::AllocaInst* CreateEntryBlockAlloca(llvm::Function* TheFunction, llvm::StringRef VarName, llvm::Type* dtype);
-llvm::Function* getFunction(std::string Name);
+llvm::Function* getFunction(Symbol Name);
 llvm::Type* getType(DataType dtype);
+/// ResetBlocks - Forget any blocks left open by an error in the last function.
+void ResetBlocks();
 
 }
 
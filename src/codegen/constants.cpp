@@ -9,49 +9,16 @@ namespace AST {
 using namespace llvm;
 using CG::TheContext;
 
-Value *DoubleExprAST::codegen() {
-    return ConstantFP::get(*TheContext, APFloat(Val));
-}
-
-/// FIX AND TURN INTO FLOATING POINT INSTEAD OF DOUBLE.
-Value *FloatExprAST::codegen() {
-    return ConstantFP::get(*TheContext, APFloat(Val));
-}
-
-Value *I64ExprAST::codegen() {
-    return ConstantInt::get(*TheContext, APInt(64, Val));
-}
-
-Value *I32ExprAST::codegen() {
-    return ConstantInt::get(*TheContext, APInt(32, Val));
-}
-
-Value *I16ExprAST::codegen() {
-    return ConstantInt::get(*TheContext, APInt(16, Val));
-}
-
-Value *I8ExprAST::codegen() {
-    return ConstantInt::get(*TheContext, APInt(8, Val));
-}
-
-Value *U64ExprAST::codegen() {
-    return ConstantInt::get(*TheContext, APInt(64, Val));
-}
-
-Value *U32ExprAST::codegen() {
-    return ConstantInt::get(*TheContext, APInt(32, Val));
-}
-
-Value *U16ExprAST::codegen() {
-    return ConstantInt::get(*TheContext, APInt(16, Val));
-}
-
-Value *U8ExprAST::codegen() {
-    return ConstantInt::get(*TheContext, APInt(8, Val));
-}
-
-Value *BoolExprAST::codegen() {
-    return ConstantInt::get(*TheContext, APInt(1, Val));
+Value *Tree::codegenNumber(const Node &N) const {
+    switch (N.Type) {
+    case type_double:
+        return ConstantFP::get(*TheContext, APFloat(N.real()));
+    case type_float:
+        return ConstantFP::get(*TheContext, APFloat((float)N.real()));
+    default:
+        // The parser already sign or zero extended the value to 64 bits
+        return ConstantInt::get(CG::getType(N.Type), N.bits(), isSigned(N.Type));
+    }
 }
 
 }
@@ -41,16 +41,15 @@ AllocaInst* CreateEntryBlockAlloca(Function* TheFunction, StringRef VarName, Typ
                              VarName);
 }
 
-Function *getFunction(std::string Name) {
+Function *getFunction(Symbol Name) {
     // First, see if the function has already been added to the current module.
-    if (auto *F = TheModule->getFunction(Name))
+    if (auto *F = TheModule->getFunction(Identifiers.name(Name)))
         return F;
 
     // If not, check whether we can codegen the declaration from some existing
     // prototype.
-    auto FI = FunctionProtos.find(Name);
-    if (FI != FunctionProtos.end())
-        return FI->second->codegen();
+    if (auto *Proto = FunctionProtos.find(Name))
+        return (*Proto)->codegen();
 
     // If no existing prototype exists, return null.
     return nullptr;
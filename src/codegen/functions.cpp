@@ -47,12 +47,12 @@ Function *PrototypeAST::codegen() {
         FunctionType::get(CG::getType(ReturnType), TypeVector, false);
 
     Function *F =
-        Function::Create(FT, Function::ExternalLinkage, Name, CG::TheModule.get());
+        Function::Create(FT, Function::ExternalLinkage, Identifiers.name(Name), CG::TheModule.get());
 
     // Set names for all arguments.
     unsigned Idx = 0;
     for (auto &Arg : F->args())
-        Arg.setName(Args[Idx++].first);
+        Arg.setName(Identifiers.name(Args[Idx++].first));
 
     return F;
 }
@@ -74,6 +74,8 @@ Function *FunctionAST::codegen() {
 
     // Record the function arguments in the NamedValues map.
     CG::NamedValues.clear();
+    CG::ResetBlocks();
+    unsigned Idx = 0;
     for (auto &Arg : TheFunction->args()) {
         // Create an alloca for this variable.
         AllocaInst *Alloca = CG::CreateEntryBlockAlloca(TheFunction, Arg.getName(), Arg.getType());
@@ -82,10 +84,10 @@ Function *FunctionAST::codegen() {
         Builder->CreateStore(&Arg, Alloca);
 
         // Add arguments to variable symbol table.
-        CG::NamedValues[std::string(Arg.getName())] = Alloca;
+        CG::NamedValues.bind(P.getArgs()[Idx++].first, Alloca);
     }
 
-    if (Value *RetVal = Body->codegen()) {
+    if (Value *RetVal = Nodes.codegen(Body)) {
         //Finish off the function.
         if (P.getDataType() == type_void)
             Builder->CreateRetVoid();
@@ -8,13 +8,21 @@ namespace AST {
 using namespace llvm;
 using CG::Builder;
 
-static std::vector<BlockAST*> BlockStack;
-static int BS_index = -1;
-Value *BlockAST::codegen() {
+/// BlockData - State of a block while its lines are being emitted.
+struct BlockData {
+    std::vector<std::pair<BasicBlock*, Value*>> ReturnFromPoints;
+    bool fleeFrom = false;
+};
+
+static std::vector<BlockData*> BlockStack;
+
+Value *Tree::codegenBlock(const Node &N) const {
+    NodeList Lines = list(N.A);
+    BlockData Data;
     std::string name = "block" + std::to_string(BlockStack.size());
     // Add self to block stack, so that content code can access it
-    BlockStack.push_back(this);
-    BS_index += 1;
+    BlockStack.push_back(&Data);
+    CG::NamedValues.enterScope();
 
     // Create blocks
     Function *TheFunction = Builder->GetInsertBlock()->getParent();
@@ -30,15 +38,15 @@ Value *BlockAST::codegen() {
     Value *RetVal = UndefValue::get(Type::getVoidTy(*CG::TheContext));
     bool hasImmediateReturn = false;
     for (unsigned i = 0, e = Lines.size(); i != e; i++) {
-        Value *Line = Lines[i]->codegen();
+        Value *Line = codegen(Lines[i]);
         if (!Line)
             return nullptr;
-        if (Lines[i]->getReturns()) {
+        if (Nodes[Lines[i]].Flags) {
             RetVal = Line;
             hasImmediateReturn = true;
             break; // Do not generate unreachable code
         }
-        if (fleeFrom)
+        if (Data.fleeFrom)
             break;
     }
     // Code gen may have changed the current block
@@ -48,34 +56,32 @@ Value *BlockAST::codegen() {
 
     // Remove self from block stack
     BlockStack.pop_back();
-    BS_index -= 1;
 
     // Pop all local variables from scope.
-    for (unsigned i = 0, e = VarNames.size(); i != e; i++)
-        CG::NamedValues[VarNames[i].first] = LocalVarAlloca[i];
+    CG::NamedValues.exitScope();
 
     // Get the return type
     Type* retType = RetVal->getType();
-    if (retType != CG::getType(getDatatype())) {
-        retType = ReturnFromPoints[0].second->getType();
+    if (retType != CG::getType(N.Type)) {
+        retType = Data.ReturnFromPoints[0].second->getType();
     }
 
     // Create the end block
     BasicBlock *AfterBB = BasicBlock::Create(*CG::TheContext, name + "end", TheFunction);
-    if (!fleeFrom) {
+    if (!Data.fleeFrom) {
         Builder->CreateBr(AfterBB);
     }
     Builder->SetInsertPoint(AfterBB);
 
     // Allow other methods of entering AfterBB
-    if (ReturnFromPoints.size() > 0) {
+    if (Data.ReturnFromPoints.size() > 0) {
         // Create the PHI node to store return values
-        PHINode *PN = Builder->CreatePHI(retType, ReturnFromPoints.size() + hasImmediateReturn, "retval");
+        PHINode *PN = Builder->CreatePHI(retType, Data.ReturnFromPoints.size() + hasImmediateReturn, "retval");
 
         // Create a return value at every return point
-        for (int i = 0; i < ReturnFromPoints.size(); i++) {
-            Builder->SetInsertPoint(ReturnFromPoints[i].first);
-            PN->addIncoming(ReturnFromPoints[i].second, ReturnFromPoints[i].first);
+        for (int i = 0; i < Data.ReturnFromPoints.size(); i++) {
+            Builder->SetInsertPoint(Data.ReturnFromPoints[i].first);
+            PN->addIncoming(Data.ReturnFromPoints[i].second, Data.ReturnFromPoints[i].first);
             Builder->CreateBr(AfterBB);
         }
         if (hasImmediateReturn)
@@ -88,10 +94,13 @@ Value *BlockAST::codegen() {
     return RetVal;
 }
 
-Value *FleeAST::codegen() {
-    BlockStack[BS_index]->fleeFrom = true;
-    if(Body != nullptr){
-        Value *body = Body->codegen();
+Value *Tree::codegenFlee(const Node &N) const {
+    NodeRef Body = N.A;
+    int Depth = N.Flags;
+
+    BlockStack.back()->fleeFrom = true;
+    if(Body != NoNode){
+        Value *body = codegen(Body);
         if (!body)
             return nullptr;
 
@@ -108,12 +117,14 @@ Value *FleeAST::codegen() {
     return UndefValue::get(Type::getVoidTy(*CG::TheContext));
 }
 
-Value *IfExprAST::codegen() {
-    if (Cond->getDatatype() != type_bool) {
-        return LogErrorCompileV("If condition should be a boolean value! Got '" + dtypeToString(Cond->getDatatype()) + "' instead.");
+Value *Tree::codegenIf(const Node &N) const {
+    NodeRef Cond = N.A, Then = N.B, Else = N.C;
+
+    if (Nodes[Cond].Type != type_bool) {
+        return LogErrorCompileV("If condition should be a boolean value! Got '" + dtypeToString(Nodes[Cond].Type) + "' instead.");
     }
 
-    Value *CondV = Cond->codegen();
+    Value *CondV = codegen(Cond);
     if (!CondV)
         return nullptr;
 
@@ -134,7 +145,7 @@ Value *IfExprAST::codegen() {
 
     // Emit then value.
     Builder->SetInsertPoint(ThenBB);
-    Value *ThenV = Then->codegen();
+    Value *ThenV = codegen(Then);
     if (!ThenV)
         return nullptr;
 
@@ -143,13 +154,13 @@ Value *IfExprAST::codegen() {
 
     // If "then" block does not have a semicolon, then if it is called, it should trigger a block return
     bool fleeFromThen = false;
-    if (Then->getReturns() && BlockStack.size() > 0) {
-        BlockStack[BS_index]->ReturnFromPoints.push_back(std::pair<BasicBlock*, Value*>(ThenBB, ThenV));
-    } else if (!BlockStack[BS_index]->fleeFrom) {
+    if (Nodes[Then].Flags && BlockStack.size() > 0) {
+        BlockStack.back()->ReturnFromPoints.push_back(std::pair<BasicBlock*, Value*>(ThenBB, ThenV));
+    } else if (!BlockStack.back()->fleeFrom) {
         Builder->CreateBr(MergeBB);
     } else {
         fleeFromThen = true;
-        BlockStack[BS_index]->fleeFrom = false;
+        BlockStack.back()->fleeFrom = false;
     }
 
     bool fleeFromElse = false;
@@ -158,7 +169,7 @@ Value *IfExprAST::codegen() {
         TheFunction->insert(TheFunction->end(), ElseBB);
         Builder->SetInsertPoint(ElseBB);
 
-        Value *ElseV = Else->codegen();
+        Value *ElseV = codegen(Else);
         if (!ElseV)
             return nullptr;
 
@@ -166,18 +177,18 @@ Value *IfExprAST::codegen() {
         ElseBB = Builder->GetInsertBlock();
 
         // If "else" block does not have a semicolon, then if it is called, it should trigger a block return
-        if (Else->getReturns() && BlockStack.size() > 0) {
-            BlockStack[BS_index]->ReturnFromPoints.push_back(std::pair<BasicBlock*, Value*>(ElseBB, ElseV));
-        } else if (!BlockStack[BS_index]->fleeFrom) {
+        if (Nodes[Else].Flags && BlockStack.size() > 0) {
+            BlockStack.back()->ReturnFromPoints.push_back(std::pair<BasicBlock*, Value*>(ElseBB, ElseV));
+        } else if (!BlockStack.back()->fleeFrom) {
             Builder->CreateBr(MergeBB);
         } else {
-            BlockStack[BS_index]->fleeFrom = false;
+            BlockStack.back()->fleeFrom = false;
             fleeFromElse = true;
         }
     }
     
     if (fleeFromElse && fleeFromThen) {
-        BlockStack[BS_index]->fleeFrom = true; 
+        BlockStack.back()->fleeFrom = true; 
     }
     else {
         TheFunction->insert(TheFunction->end(), MergeBB);
@@ -187,18 +198,23 @@ Value *IfExprAST::codegen() {
     return UndefValue::get(Type::getVoidTy(*CG::TheContext));
 }
 
-Value *ForExprAST::codegen() {
-    if (End->getDatatype() != type_bool) {
-        return LogErrorCompileV("For loop condition should be bool type. Got '" + dtypeToString(End->getDatatype()) + "' instead");
+Value *Tree::codegenFor(const Node &N) const {
+    Symbol VarName = N.A;
+    DataType VarType = (DataType)N.Flags;
+    const uint32_t *Parts = extra(N.B);
+    NodeRef Start = Parts[0], End = Parts[1], Step = Parts[2], Body = Parts[3];
+
+    if (Nodes[End].Type != type_bool) {
+        return LogErrorCompileV("For loop condition should be bool type. Got '" + dtypeToString(Nodes[End].Type) + "' instead");
     }
 
     Function *TheFunction = Builder->GetInsertBlock()->getParent();
 
     //Create an alloca for the variable in the entry block.
-    AllocaInst *Alloca = CG::CreateEntryBlockAlloca(TheFunction, VarName, CG::getType(VarType));
+    AllocaInst *Alloca = CG::CreateEntryBlockAlloca(TheFunction, Identifiers.name(VarName), CG::getType(VarType));
 
     // Emit the start code first, without 'variable' in scope.
-    Value *StartVal = Start->codegen();
+    Value *StartVal = codegen(Start);
     if (!StartVal)
         return nullptr;
 
@@ -216,18 +232,18 @@ Value *ForExprAST::codegen() {
 
     // Within the loop, the variable is defined equal to the PHI node. If it
     // shadows an existing variable, we have to restore it, so save it now.
-    AllocaInst *OldVal = CG::NamedValues[VarName];
-    CG::NamedValues[VarName] = Alloca;
+    CG::NamedValues.enterScope();
+    CG::NamedValues.bind(VarName, Alloca);
 
     // Emit the body of the loop. This, like any other expr, can change the
     // current BB. Note that we ignore the value computed by the body, but don't
     // allow an error.
-    Value* BodyV = Body->codegen();
+    Value* BodyV = codegen(Body);
     if (!BodyV)
         return nullptr;
 
     // Emit the step value.
-    Value *StepVal = Step->codegen();
+    Value *StepVal = codegen(Step);
     if (!StepVal)
         return nullptr;
 
@@ -237,7 +253,7 @@ Value *ForExprAST::codegen() {
     Builder->SetInsertPoint(CondBB);
 
     // Compute the end condition
-    Value *EndCond = End->codegen();
+    Value *EndCond = codegen(End);
     if (!EndCond)
         return nullptr;
 
@@ -256,44 +272,41 @@ Value *ForExprAST::codegen() {
     Builder->SetInsertPoint(AfterBB);
 
     //Restore the unshadowed variable.
-    if (OldVal)
-        CG::NamedValues[VarName] = OldVal;
-    else
-        CG::NamedValues.erase(VarName);
+    CG::NamedValues.exitScope();
 
     return UndefValue::get(Type::getVoidTy(*CG::TheContext));
 }
 
-Value *VarExprAST::codegen() {
-    std::vector<AllocaInst *> OldBindings;
+Value *Tree::codegenVar(const Node &N) const {
+    // Names and initializers alternate
+    NodeList Vars = list(N.A);
 
     Function *TheFunction = Builder->GetInsertBlock()->getParent();
 
     // Save the first variable, in case it is needed latter
-    const std::string &VarName = VarNames[0].first;
-    ExprAST *Init = VarNames[0].second.get();
+    Symbol VarName = Vars[0];
+    NodeRef Init = Vars[1];
 
     Value *FirstInitVal;
     if (Init) {
-        FirstInitVal = Init->codegen();
+        FirstInitVal = codegen(Init);
         if (!FirstInitVal)
             return nullptr;
     } else {
         // If not specified, throw an error.
-        return LogCompilerBug("Did not get an initial value from variable expression for '" + VarName + "'");
+        return LogCompilerBug("Did not get an initial value from variable expression for '" + Identifiers.name(VarName) + "'");
     }
 
-    AllocaInst *Alloca = CG::CreateEntryBlockAlloca(TheFunction, VarName, FirstInitVal->getType());
+    AllocaInst *Alloca = CG::CreateEntryBlockAlloca(TheFunction, Identifiers.name(VarName), FirstInitVal->getType());
     Builder->CreateStore(FirstInitVal, Alloca);
 
-    OldBindings.push_back(CG::NamedValues[VarName]);
-    CG::NamedValues[VarName] = Alloca;
+    CG::NamedValues.bind(VarName, Alloca);
 
     // Save all the other variables
     // Register all variables and emit their initializer.
-    for (unsigned i = 1, e = VarNames.size(); i != e; i++) {
-        const std::string &VarName = VarNames[i].first;
-        ExprAST *Init = VarNames[i].second.get();
+    for (unsigned i = 1, e = Vars.size() / 2; i != e; i++) {
+        Symbol VarName = Vars[2 * i];
+        NodeRef Init = Vars[2 * i + 1];
 
         /// Emit the initializer before adding the variable to scope, this prevents
         /// the initializer from referencing the variable itself, and permits stuff
@@ -302,7 +315,7 @@ Value *VarExprAST::codegen() {
         /// var a = a in... # refers to outer 'a'.
         Value *InitVal;
         if (Init) {
-            InitVal = Init->codegen();
+            InitVal = codegen(Init);
             if (!InitVal){
                 return nullptr;
             }
@@ -310,22 +323,11 @@ Value *VarExprAST::codegen() {
             InitVal = FirstInitVal;
         }
 
-        AllocaInst *Alloca = CG::CreateEntryBlockAlloca(TheFunction, VarName, InitVal->getType());
+        AllocaInst *Alloca = CG::CreateEntryBlockAlloca(TheFunction, Identifiers.name(VarName), InitVal->getType());
         Builder->CreateStore(InitVal, Alloca);
 
-        // Remember the old variable binding so that we can restore the binding when
-        // we unrecurse.
-        OldBindings.push_back(CG::NamedValues[VarName]);
-
-        // Remember this binding.
-        CG::NamedValues[VarName] = Alloca;
-    }
-
-    // Feed deepest level current local variables
-    BlockStack[BS_index]->LocalVarAlloca.insert(std::end(BlockStack[BS_index]->LocalVarAlloca),
-                                            std::begin(OldBindings), std::end(OldBindings));
-    for (int i = VarNames.size() - 1; i >= 0; i--) {
-        BlockStack[BS_index]->VarNames.push_back(std::move(VarNames[i]));
+        // Remember this binding. The enclosing block undoes it on exit.
+        CG::NamedValues.bind(VarName, Alloca);
     }
 
     // Return nothing
@@ -333,3 +335,11 @@ Value *VarExprAST::codegen() {
 }
 
 }
+
+namespace CG {
+
+void ResetBlocks() {
+    AST::BlockStack.clear();
+}
+
+}
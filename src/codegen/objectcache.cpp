@@ -0,0 +1,78 @@
+#include "./objectcache.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Support/raw_ostream.h"
+#include <string>
+#include <utility>
+
+namespace CG {
+
+using namespace llvm;
+
+DiskObjectCache::DiskObjectCache(std::string Dir, std::string Salt)
+    : Dir(std::move(Dir)), Salt(std::move(Salt)) {
+    sys::fs::create_directories(this->Dir);
+}
+
+std::string DiskObjectCache::getPath(const Module *M) {
+    std::string IR;
+    raw_string_ostream OS(IR);
+    M->print(OS, nullptr);
+    OS.flush();
+
+    SHA1 Hasher;
+    Hasher.update(Salt);
+    Hasher.update(IR);
+
+    SmallString<128> Path(Dir);
+    sys::path::append(Path, toHex(Hasher.final(), true) + ".o");
+    return std::string(Path);
+}
+
+std::unique_ptr<MemoryBuffer> DiskObjectCache::getObject(const Module *M) {
+    std::string Path = getPath(M);
+    auto Obj = MemoryBuffer::getFile(Path, false, false);
+    if (Obj)
+        return std::move(*Obj);
+
+    std::lock_guard<std::mutex> Lock(PendingMutex);
+    PendingPaths[M] = std::move(Path);
+    return nullptr;
+}
+
+void DiskObjectCache::notifyObjectCompiled(const Module *M, MemoryBufferRef Obj) {
+    std::string Path;
+    {
+        std::lock_guard<std::mutex> Lock(PendingMutex);
+        auto It = PendingPaths.find(M);
+        if (It == PendingPaths.end())
+            return; // Never looked up, so there is no key taken before codegen
+        Path = std::move(It->second);
+        PendingPaths.erase(It);
+    }
+
+    // Write to a unique file first, so that readers in other processes never
+    // see a partially written object.
+    int FD;
+    SmallString<128> TmpPath;
+    if (sys::fs::createUniqueFile(Path + ".%%%%%%%%.tmp", FD, TmpPath))
+        return;
+    {
+        raw_fd_ostream OS(FD, true);
+        OS << Obj.getBuffer();
+        if (OS.has_error()) {
+            OS.clear_error();
+            sys::fs::remove(TmpPath);
+            return;
+        }
+    }
+    if (sys::fs::rename(TmpPath, Path))
+        sys::fs::remove(TmpPath);
+}
+
+}
@@ -0,0 +1,44 @@
+#ifndef CODEGEN_OBJECT_CACHE
+#define CODEGEN_OBJECT_CACHE
+
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace llvm {
+    class Module;
+    class MemoryBuffer;
+    class MemoryBufferRef;
+}
+
+namespace CG {
+
+/// DiskObjectCache - Compiled objects stored in a directory, keyed by a hash of
+/// the module's IR and the target settings in Salt. Several processes can share
+/// one directory, since entries are written to a temporary file and renamed into
+/// place.
+///
+/// The key is taken when the object is looked up. Codegen passes change the
+/// module before notifyObjectCompiled is called, so hashing it again there
+/// would store the object under a key no later lookup uses.
+class DiskObjectCache : public llvm::ObjectCache {
+    std::string Dir;
+    std::string Salt;
+    // Path of each module that missed and is being compiled now
+    std::mutex PendingMutex;
+    std::map<const llvm::Module *, std::string> PendingPaths;
+
+    std::string getPath(const llvm::Module *M);
+
+public:
+    DiskObjectCache(std::string Dir, std::string Salt);
+
+    void notifyObjectCompiled(const llvm::Module *M, llvm::MemoryBufferRef Obj) override;
+    std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *M) override;
+};
+
+}
+
+#endif
@@ -13,24 +13,31 @@ int optimLevel;
 void SetLevel(int level){
     optimLevel = level;
 }
+int GetLevel(){
+    return optimLevel;
+}
 
-void Optimize() {
-    if (optimLevel == 1){
+void AddOptimizationPasses(FunctionPassManager &FPM, int level) {
+    if (level == 1){
         // Add transform passes
         // Promote allocas to registers
-        CG::passes.TheFPM->addPass(PromotePass());
+        FPM.addPass(PromotePass());
     }
-    if (optimLevel == 2){
+    if (level == 2){
         // Add transform passes
         // Promote allocas to registers
-        CG::passes.TheFPM->addPass(PromotePass());
+        FPM.addPass(PromotePass());
         // Do simple peephole optimizations and bit twiddling optimizations.
-        CG::passes.TheFPM->addPass(InstCombinePass());
+        FPM.addPass(InstCombinePass());
         // reassociate expressions.
-        CG::passes.TheFPM->addPass(ReassociatePass());
+        FPM.addPass(ReassociatePass());
         // Eliminate Common SubExpressions.
-        CG::passes.TheFPM->addPass(GVNPass());
+        FPM.addPass(GVNPass());
         // Simplify the control flow graph (deleting unreachable blocks etc.)
-        CG::passes.TheFPM->addPass(SimplifyCFGPass());
+        FPM.addPass(SimplifyCFGPass());
     }
 }
+
+void Optimize() {
+    AddOptimizationPasses(*CG::passes.TheFPM, optimLevel);
+}
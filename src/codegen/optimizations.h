@@ -3,5 +3,6 @@
 
 void Optimize();
 void SetLevel(int level);
+int GetLevel();
 
 #endif
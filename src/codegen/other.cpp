@@ -37,76 +37,112 @@ using namespace llvm::orc;
 using CG::Builder;
 using CG::TheContext;
 
-Value *VariableExprAST::codegen() {
+Value *Tree::codegen(NodeRef Ref) const {
+    const Node &N = Nodes[Ref];
+    switch (N.Kind) {
+    case node_number:
+        return codegenNumber(N);
+    case node_variable:
+        return codegenVariable(N);
+    case node_line:
+        return codegenLine(N);
+    case node_binary:
+        return codegenBinary(N);
+    case node_unary:
+        return codegenUnary(N);
+    case node_call:
+        return codegenCall(N);
+    case node_block:
+        return codegenBlock(N);
+    case node_flee:
+        return codegenFlee(N);
+    case node_if:
+        return codegenIf(N);
+    case node_for:
+        return codegenFor(N);
+    case node_while:
+        return codegenWhile(N);
+    case node_var:
+        return codegenVar(N);
+    case node_none:
+        break;
+    }
+    return LogCompilerBug("Can not generate code for node kind #" + std::to_string(N.Kind));
+}
+
+Value *Tree::codegenVariable(const Node &N) const {
+    Symbol Name = N.A;
+
     // Look this variable up in the funcion
-    AllocaInst *A = CG::NamedValues[Name];
+    AllocaInst **A = CG::NamedValues.find(Name);
     if (!A)
-        LogErrorCompileV("Unknown variable name '" + Name + "'.\n" + 
+        return LogErrorCompileV("Unknown variable name '" + Identifiers.name(Name) + "'.\n" + 
                 "Name did not exist in NamedValues table");
 
-    return Builder->CreateLoad(A->getAllocatedType(), A, Name.c_str());
+    return Builder->CreateLoad((*A)->getAllocatedType(), *A, Identifiers.name(Name));
 }
 
-Value *BinaryExprAST::codegen() {
+Value *Tree::codegenBinary(const Node &N) const {
+    int Op = N.A;
+    NodeRef LHS = N.B, RHS = N.C;
+
     // Special case '=' because we don't want to emit the LHS as an expression.
     if (Op == '=') {
-        // This assumes we're building without RTTI because LLVM builds that way by
-        // default. If you build LLVM with RTTI this can be changed to a
-        // dynamic_cast for automatic error checking.
-        VariableExprAST *LHSE = static_cast<VariableExprAST *>(LHS.get());
-        if (!LHSE)
+        const Node &LHSE = Nodes[LHS];
+        if (LHSE.Kind != node_variable)
             return LogErrorCompileV("destination of '=' must be a variable");
 
         //Codegen the RHS.
-        Value *Val = RHS->codegen();
+        Value *Val = codegen(RHS);
         if (!Val)
             return nullptr;
 
         // Look up the name.
-        Value *Variable = CG::NamedValues[LHSE->getName()];
+        AllocaInst **Variable = CG::NamedValues.find(LHSE.A);
         if (!Variable)
-            return LogErrorCompileV("Assignment to unknown variable '" + LHSE->getName() + "'");
+            return LogErrorCompileV("Assignment to unknown variable '" + Identifiers.name(LHSE.A) + "'");
 
-        Builder->CreateStore(Val, Variable);
+        Builder->CreateStore(Val, *Variable);
         return Val;
     }
-    Value *L = LHS->codegen();
-    Value *R = RHS->codegen();
-    DataType LT = LHS->getDatatype();
-    DataType RT = RHS->getDatatype();
+    Value *L = codegen(LHS);
+    Value *R = codegen(RHS);
+    DataType LT = Nodes[LHS].Type;
+    DataType RT = Nodes[RHS].Type;
+    DataType ET = (DataType)N.Flags;
     if(!L || !R)
         return nullptr;
 
     switch (Op) {
     case '+':
-        return CG::BinOps::Add(LT, RT, L, R);
+        return CG::BinOps::Add(LT, RT, ET, L, R);
     case '-':
-        return CG::BinOps::Sub(LT, RT, L, R);
+        return CG::BinOps::Sub(LT, RT, ET, L, R);
     case '*':
-        return CG::BinOps::Mul(LT, RT, L, R);
+        return CG::BinOps::Mul(LT, RT, ET, L, R);
     case '/':
-        return CG::BinOps::Div(LT, RT, L, R);
+        return CG::BinOps::Div(LT, RT, ET, L, R);
     case '%':
-        return CG::BinOps::Mod(LT, RT, L, R);
+        return CG::BinOps::Mod(LT, RT, ET, L, R);
     case '<':
     case '>':
     case op_eq:
     case op_geq:
     case op_leq:
     case op_neq:
-        return CG::BinOps::EqualityCheck(LT, RT, L, R, Op);
+        return CG::BinOps::EqualityCheck(LT, RT, ET, L, R, Op);
     case '|':
-        return CG::BinOps::LogicGate(LT, RT, L, R, 1);
+        return CG::BinOps::LogicGate(LT, RT, ET, L, R, 1);
     case op_or:
-        return CG::BinOps::LogicGate(LT, RT, L, R, 0);
+        return CG::BinOps::LogicGate(LT, RT, ET, L, R, 0);
     case '&':
-        return CG::BinOps::LogicGate(LT, RT, L, R, 2);
+        return CG::BinOps::LogicGate(LT, RT, ET, L, R, 2);
     default:
         break;
     }
     // If it wasn't a builtin binary operator, it must be a user defined one. Emit
     // a call to it.
-    Function *F = CG::getFunction(std::string("operator") + tokop(Op));
+    Function *F = CG::getFunction(Identifiers.intern("operator" + tokop(Op)));
     if (!F)
         LogCompilerBug("binary operator not found! '" + std::string("operator") + tokop(Op) + "' does not exist");
 
@@ -114,16 +150,20 @@ Value *BinaryExprAST::codegen() {
     return Builder->CreateCall(F, Ops, "binop");
 }
 
-Value *UnaryExprAST::codegen() {
-    Value *OperandV = Operand->codegen();
-    DataType DT = Operand->getDatatype();
+Value *Tree::codegenUnary(const Node &N) const {
+    int Opcode = N.A;
+    NodeRef Operand = N.B;
+
+    Value *OperandV = codegen(Operand);
+    DataType DT = Nodes[Operand].Type;
     if (!OperandV)
         return nullptr;
 
-    if (UnopProperties.count(Opcode) == 0){
+    UnopProperty *Unop = UnopProperties.find(Opcode);
+    if (!Unop){
         return LogCompilerBug("Unknown unary operator '" + tokop(Opcode) + "'");
     }
-    if (UnopProperties[Opcode].count(DT) == 0){
+    if (Unop->result(DT) == type_UNDECIDED){
         return LogCompilerBug("Can not perform unary operator '" + tokop(Opcode) + "' with type '" + dtypeToString(DT) + "'");
     }
 
@@ -136,14 +176,17 @@ Value *UnaryExprAST::codegen() {
         break;
     }
 
-    Function *F = CG::getFunction(std::string("operator") + tokop(Opcode));
+    Function *F = CG::getFunction(Identifiers.intern("operator" + tokop(Opcode)));
     if (!F)
         return LogCompilerBug("Unknown unary operator '" + tokop(Opcode) + "' after all checks completed");
 
     return Builder->CreateCall(F, OperandV, "unop");
 }
 
-Value *CallExprAST::codegen() {
+Value *Tree::codegenCall(const Node &N) const {
+    Symbol Callee = N.A;
+    NodeList Args = list(N.B);
+
     //Look up the name in the global module table.
     Function *CalleeF = CG::getFunction(Callee);
     if (!CalleeF)
@@ -156,20 +199,22 @@ Value *CallExprAST::codegen() {
 
     std::vector<Value *> ArgsV;
     for (unsigned i = 0, e = Args.size(); i != e; i++) {
-        ArgsV.push_back(Args[i]->codegen());
+        ArgsV.push_back(codegen(Args[i]));
         if (!ArgsV.back())
             return nullptr;
     }
 
-    if (getDatatype() == type_void)
+    if (N.Type == type_void)
         return Builder->CreateCall(CalleeF, ArgsV);
     return Builder->CreateCall(CalleeF, ArgsV, "calltmp");
 }
 
-Value *WhileExprAST::codegen() {
-    if (Condition->getDatatype() != type_bool) {
+Value *Tree::codegenWhile(const Node &N) const {
+    NodeRef Condition = N.A, Body = N.B;
+
+    if (Nodes[Condition].Type != type_bool) {
         return LogErrorCompileV("For loop condition should be bool type. Got '"
-                + dtypeToString(Condition->getDatatype()) + "' instead");
+                + dtypeToString(Nodes[Condition].Type) + "' instead");
     }
 
     Function *TheFunction = Builder->GetInsertBlock()->getParent();
@@ -184,7 +229,7 @@ Value *WhileExprAST::codegen() {
     // Emit the body of the loop. This, like any other expr, can change the
     // current BB. Note that we ignore the value computed by the body, but don't
     // allow an error.
-    Value* BodyV = Body->codegen();
+    Value* BodyV = codegen(Body);
     if (!BodyV)
         return nullptr;
 
@@ -193,7 +238,7 @@ Value *WhileExprAST::codegen() {
     Builder->SetInsertPoint(CondBB);
 
     // Compute the end condition
-    Value *EndCond = Condition->codegen();
+    Value *EndCond = codegen(Condition);
     if (!EndCond)
         return nullptr;
 
@@ -214,9 +259,9 @@ Value *WhileExprAST::codegen() {
     return UndefValue::get(Type::getVoidTy(*TheContext));
 }
 
-Value *LineAST::codegen() {
-    Value *body = Body->codegen();
-    if (returns == true) {
+Value *Tree::codegenLine(const Node &N) const {
+    Value *body = codegen(N.A);
+    if (N.Flags) {
         return body;
     } else {
         return UndefValue::get(Type::getVoidTy(*TheContext));
@@ -24,4 +24,7 @@ extern Passes passes;
 
 }
 
+/// AddOptimizationPasses - Fill FPM with the pipeline for the given -O level.
+void AddOptimizationPasses(llvm::FunctionPassManager &FPM, int level);
+
 #endif
@@ -0,0 +1,190 @@
+#include "./tiering.h"
+#include "./CG_internal.h"
+#include "./passes.h"
+#include "../../include/QuailJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+namespace CG {
+namespace Tiering {
+
+using namespace llvm;
+using namespace llvm::orc;
+
+/// TieredFunction - A function that is running at tier 0, along with an
+/// untouched copy of its IR to build the optimized version from.
+struct TieredFunction {
+    std::string Name;
+    ThreadSafeModule IR;
+};
+
+static uint64_t Threshold = 1000;
+static std::mutex TierMutex;
+static std::vector<TieredFunction> TieredFunctions;
+
+// Recompiles run one at a time on a thread of their own, however many
+// functions get hot. They can't share the session's pool: a recompile waits
+// on a lookup whose work may be queued behind it there.
+static std::unique_ptr<FixedThreadPoolTaskDispatcher> Recompiler;
+
+void SetThreshold(uint64_t threshold) {
+    Threshold = threshold;
+}
+
+// Move the body of Name to Name + Suffix, and leave a declaration of Name in
+// its place. Recursive calls then go through the stub too, so they pick up the
+// optimized body once it is swapped in.
+static Function *RenameBody(Module &M, const std::string &Name, const std::string &Suffix) {
+    Function *Body = M.getFunction(Name);
+    Body->setName(Name + Suffix);
+    Function *Decl = Function::Create(Body->getFunctionType(), Function::ExternalLinkage, Name, M);
+    Body->replaceAllUsesWith(Decl);
+    return Body;
+}
+
+// Count calls on entry to F, and ask for a tier up on the call that reaches
+// the threshold.
+static void InsertEntryCounter(Module &M, Function &F, uint64_t ID) {
+    LLVMContext &Ctx = M.getContext();
+    Type *I64 = Type::getInt64Ty(Ctx);
+    GlobalVariable *Counter = new GlobalVariable(M, I64, false, GlobalValue::InternalLinkage,
+            ConstantInt::get(I64, 0), F.getName() + ".calls");
+    FunctionCallee TierUp = M.getOrInsertFunction("quail_tier_up", Type::getVoidTy(Ctx), I64);
+
+    // Keep the allocas at the top of the entry block
+    BasicBlock &Entry = F.getEntryBlock();
+    BasicBlock::iterator InsertPt = Entry.getFirstInsertionPt();
+    while (isa<AllocaInst>(*InsertPt))
+        ++InsertPt;
+
+    IRBuilder<> B(&Entry, InsertPt);
+    Value *Calls = B.CreateAdd(B.CreateLoad(I64, Counter), ConstantInt::get(I64, 1), "calls");
+    B.CreateStore(Calls, Counter);
+    Value *IsHot = B.CreateICmpEQ(Calls, ConstantInt::get(I64, Threshold), "ishot");
+    Instruction *ThenTerm = SplitBlockAndInsertIfThen(IsHot, &*B.GetInsertPoint(), false);
+    B.SetInsertPoint(ThenTerm);
+    B.CreateCall(TierUp, ConstantInt::get(I64, ID));
+}
+
+// Run the -O2 pipeline over M. This happens off the main thread, so it gets
+// its own managers rather than the ones in CG::passes.
+static Error OptimizeModule(Module &M) {
+    LoopAnalysisManager LAM;
+    FunctionAnalysisManager FAM;
+    CGSCCAnalysisManager CGAM;
+    ModuleAnalysisManager MAM;
+    // Each recompile gets its own TargetMachine, they are not thread safe
+    auto TM = TheJIT->createTargetMachine();
+    if (!TM)
+        return TM.takeError();
+    PassBuilder PB(TM->get());
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+    FunctionPassManager FPM;
+    AddOptimizationPasses(FPM, 2);
+    for (Function &F : M) {
+        if (!F.isDeclaration())
+            FPM.run(F, FAM);
+    }
+    return Error::success();
+}
+
+void AddDefinition(std::unique_ptr<Module> M, std::unique_ptr<LLVMContext> Ctx,
+        const std::string &Name) {
+    ThreadSafeModule TSM(std::move(M), std::move(Ctx));
+
+    uint64_t ID;
+    {
+        std::lock_guard<std::mutex> Lock(TierMutex);
+        ID = TieredFunctions.size();
+        TieredFunctions.push_back({Name, cloneToNewContext(TSM)});
+    }
+
+    TSM.withModuleDo([&](Module &Mod) {
+        Function *Body = RenameBody(Mod, Name, ".tier0");
+        InsertEntryCounter(Mod, *Body, ID);
+    });
+
+    // The stub has to exist before the body is linked, since the body may
+    // call itself through it.
+    ExitOnErr(TheJIT->addTierStub(Name));
+    ExitOnErr(TheJIT->addModule(std::move(TSM)));
+    auto Body = ExitOnErr(TheJIT->lookup(Name + ".tier0"));
+    ExitOnErr(TheJIT->updateTierStub(Name, Body.getAddress()));
+}
+
+static Error Recompile(const std::string &Name, ThreadSafeModule TSM) {
+    if (auto Err = TSM.withModuleDo([&](Module &Mod) {
+            RenameBody(Mod, Name, ".tier2");
+            return OptimizeModule(Mod);
+        }))
+        return Err;
+
+    if (auto Err = TheJIT->addOptimizedModule(std::move(TSM)))
+        return Err;
+    auto Body = TheJIT->lookup(Name + ".tier2");
+    if (!Body)
+        return Body.takeError();
+    return TheJIT->updateTierStub(Name, Body->getAddress());
+}
+
+static void RequestTierUp(uint64_t ID) {
+    std::lock_guard<std::mutex> Lock(TierMutex);
+    std::string Name = TieredFunctions[ID].Name;
+    ThreadSafeModule TSM = std::move(TieredFunctions[ID].IR);
+    if (!Recompiler)
+        Recompiler = std::make_unique<FixedThreadPoolTaskDispatcher>(1);
+
+    // This runs on a thread the program knows nothing about, so a failure
+    // can't be reported to it. The stub keeps pointing at tier 0 instead.
+    Recompiler->dispatch(makeGenericNamedTask(
+        [Name, TSM = std::move(TSM)]() mutable {
+            if (auto Err = Recompile(Name, std::move(TSM)))
+                logAllUnhandledErrors(std::move(Err), errs(),
+                                      "Could not optimize '" + Name + "': ");
+        },
+        "tier up"));
+}
+
+void Shutdown() {
+    std::unique_ptr<FixedThreadPoolTaskDispatcher> Running;
+    {
+        std::lock_guard<std::mutex> Lock(TierMutex);
+        Running = std::move(Recompiler);
+    }
+    // Waits for the recompiles already queued
+    if (Running)
+        Running->shutdown();
+}
+
+}
+}
+
+/// quail_tier_up - Called by tier 0 code when a function crosses the call
+/// threshold.
+extern "C" DLLEXPORT void quail_tier_up(int64_t ID) {
+    CG::Tiering::RequestTierUp(ID);
+}
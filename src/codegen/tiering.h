@@ -0,0 +1,30 @@
+#ifndef CODEGEN_TIERING
+#define CODEGEN_TIERING
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace llvm {
+    class Module;
+    class LLVMContext;
+}
+
+namespace CG {
+namespace Tiering {
+
+void SetThreshold(uint64_t threshold);
+
+/// AddDefinition - JIT the function Name from M at tier 0. Calls to it go
+/// through a stub, which is repointed to an -O2 build once it gets hot.
+void AddDefinition(std::unique_ptr<llvm::Module> M, std::unique_ptr<llvm::LLVMContext> Ctx,
+        const std::string &Name);
+
+/// Shutdown - Wait for the recompiles still queued or running in the
+/// background.
+void Shutdown();
+
+}
+}
+
+#endif
@@ -1,7 +1,4 @@
 #include "datatype.h"
-#include "./BinopsData.h"
-#include <algorithm>
-#include <iterator>
 
 std::string dtypeToString(DataType dtype) {
     switch (dtype){
@@ -69,73 +66,3 @@ char dtypeToChar(DataType dtype) {
             return 'U'; // unknown
     }
 }
-
-bool isSigned(DataType dtype){
-    if (dtype == type_bool || dtype == type_u8 || dtype == type_u16 ||
-            dtype == type_u32 || dtype == type_u64) { return false; }
-    else { return true; }
-}
-bool isFP(DataType dtype){
-    if (dtype == type_double || dtype == type_float) { return true; }
-    else { return false; }
-}
-bool isInt(DataType dtype){
-    if (dtype == type_i8 || dtype == type_i16 || 
-            dtype == type_i32 || dtype == type_i64 || 
-            dtype == type_u8 || dtype == type_u16 || 
-            dtype == type_u32 || dtype == type_u64)
-    { return true; }
-    else { return false; }
-}
-
-unsigned getIndex(DataType dtype){
-    return std::distance(priorities, std::find(priorities, priorities + numPriorities, dtype));
-}
-bool canExpandToDouble(DataType dtype){
-    return getIndex(dtype) > getIndex(type_double);
-}
-
-DataType getExpandType(DataType left, DataType right) {
-    DataType biggerType = type_UNDECIDED;
-    DataType smallerType = type_UNDECIDED;
-    for(int i = 0; i <= numPriorities; i++){
-        if (left == priorities[i] || right == priorities[i]){
-            if(biggerType == type_UNDECIDED)
-                biggerType = priorities[i];
-            smallerType = priorities[i];
-        }
-    }
-
-    // No need for an expansion if both sides are the same already
-    if (biggerType == smallerType)
-        return biggerType;
-
-    // If the smaller type is floating point, but the larger type is not
-    // there is a risk of data loss, if both can not be converted to a double.
-    if (isFP(smallerType) && !isFP(biggerType)) {
-        if (canExpandToDouble(biggerType)){
-            return type_double;
-        }
-        return type_UNDECIDED;
-    }
-
-    //  If the larger value is an unsigned int, while the smaller one is signed
-    //  It must expand to a larger signed int type. u8 and i8 expand to i16
-    if (!isFP(smallerType) && !isFP(biggerType) && isSigned(smallerType) && !isSigned(biggerType)) {
-        switch (biggerType){
-            case type_u8:
-                return type_i16;
-            case type_u16:
-                return type_i32;
-            case type_u32:
-                return type_i64;
-            // if it is already 64 bits, there is no possible expansion.
-            // Data loss may occur
-            default:
-                return type_UNDECIDED;
-        }
-    }
-
-    return biggerType;
-}
-
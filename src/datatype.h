@@ -1,9 +1,11 @@
 #ifndef DATATYPE
 #define DATATYPE
 
+#include <array>
+#include <cstdint>
 #include <string>
-enum DataType {
-    type_UNDECIDED = 999,
+enum DataType : uint8_t {
+    type_UNDECIDED = 255,
     type_bool = 0,
     type_i8 = 1,
     type_i16 = 2,
@@ -18,12 +20,119 @@ enum DataType {
     type_void = 11,
 };
 
+/// numTypes - How many DataTypes there are, for tables indexed by them.
+constexpr int numTypes = type_void + 1;
+
+/// priorities - The value types, widest first. An operation on two of them
+/// is done in the wider one, see getExpandType.
+constexpr DataType priorities[] = {type_u64, type_i64, type_double, type_u32, type_i32,
+    type_float, type_u16, type_i16, type_u8, type_i8, type_bool};
+constexpr int numPriorities = 10;
+
 std::string dtypeToString(DataType dtype);
 char dtypeToChar(DataType dtype);
 
-bool isFP(DataType dtype);
-bool isSigned(DataType dtype);
-bool isInt(DataType dtype);
-DataType getExpandType(DataType left, DataType right);
+constexpr bool isSigned(DataType dtype){
+    if (dtype == type_bool || dtype == type_u8 || dtype == type_u16 ||
+            dtype == type_u32 || dtype == type_u64) { return false; }
+    else { return true; }
+}
+constexpr bool isFP(DataType dtype){
+    if (dtype == type_double || dtype == type_float) { return true; }
+    else { return false; }
+}
+constexpr bool isInt(DataType dtype){
+    if (dtype == type_i8 || dtype == type_i16 || 
+            dtype == type_i32 || dtype == type_i64 || 
+            dtype == type_u8 || dtype == type_u16 || 
+            dtype == type_u32 || dtype == type_u64)
+    { return true; }
+    else { return false; }
+}
+
+constexpr unsigned getIndex(DataType dtype){
+    unsigned i = 0;
+    while (i < numPriorities && priorities[i] != dtype)
+        i++;
+    return i;
+}
+
+constexpr std::array<bool, numTypes> makeExpandsToDouble() {
+    std::array<bool, numTypes> Table{};
+    for (int i = 0; i < numTypes; i++)
+        Table[i] = getIndex((DataType)i) > getIndex(type_double);
+    return Table;
+}
+inline constexpr std::array<bool, numTypes> ExpandsToDouble = makeExpandsToDouble();
+
+constexpr bool canExpandToDouble(DataType dtype){
+    if (dtype < numTypes)
+        return ExpandsToDouble[dtype];
+    return getIndex(dtype) > getIndex(type_double);
+}
+
+/// resolveExpandType - The type an operation between left and right is done
+/// in, or type_UNDECIDED if one of them would lose data in it.
+constexpr DataType resolveExpandType(DataType left, DataType right) {
+    DataType biggerType = type_UNDECIDED;
+    DataType smallerType = type_UNDECIDED;
+    for(int i = 0; i <= numPriorities; i++){
+        if (left == priorities[i] || right == priorities[i]){
+            if(biggerType == type_UNDECIDED)
+                biggerType = priorities[i];
+            smallerType = priorities[i];
+        }
+    }
+
+    // No need for an expansion if both sides are the same already
+    if (biggerType == smallerType)
+        return biggerType;
+
+    // If the smaller type is floating point, but the larger type is not
+    // there is a risk of data loss, if both can not be converted to a double.
+    if (isFP(smallerType) && !isFP(biggerType)) {
+        if (canExpandToDouble(biggerType)){
+            return type_double;
+        }
+        return type_UNDECIDED;
+    }
+
+    //  If the larger value is an unsigned int, while the smaller one is signed
+    //  It must expand to a larger signed int type. u8 and i8 expand to i16
+    if (!isFP(smallerType) && !isFP(biggerType) && isSigned(smallerType) && !isSigned(biggerType)) {
+        switch (biggerType){
+            case type_u8:
+                return type_i16;
+            case type_u16:
+                return type_i32;
+            case type_u32:
+                return type_i64;
+            // if it is already 64 bits, there is no possible expansion.
+            // Data loss may occur
+            default:
+                return type_UNDECIDED;
+        }
+    }
+
+    return biggerType;
+}
+
+constexpr std::array<std::array<DataType, numTypes>, numTypes> makeExpandTypes() {
+    std::array<std::array<DataType, numTypes>, numTypes> Table{};
+    for (int i = 0; i < numTypes; i++)
+        for (int j = 0; j < numTypes; j++)
+            Table[i][j] = resolveExpandType((DataType)i, (DataType)j);
+    return Table;
+}
+/// ExpandTypes - resolveExpandType of every pair of types, worked out at
+/// compile time.
+inline constexpr std::array<std::array<DataType, numTypes>, numTypes> ExpandTypes = makeExpandTypes();
+
+/// getExpandType - Same as resolveExpandType, from the table where it can.
+constexpr DataType getExpandType(DataType left, DataType right) {
+    if (left < numTypes && right < numTypes)
+        return ExpandTypes[left][right];
+    return resolveExpandType(left, right);
+}
 
 #endif
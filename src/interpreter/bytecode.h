@@ -0,0 +1,106 @@
+#ifndef INTERPRETER_BYTECODE
+#define INTERPRETER_BYTECODE
+
+#include "../datatype.h"
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Interp {
+
+/// Value - One interpreter register. Integers are kept extended to 64 bits
+/// (sign extended when signed, zero extended otherwise), so widening an
+/// integer never needs an instruction.
+union Value {
+    int64_t I;
+    uint64_t U;
+    double D;
+    float F;
+
+    static Value ofInt(int64_t I) { Value V; V.I = I; return V; }
+    static Value ofUInt(uint64_t U) { Value V; V.U = U; return V; }
+    static Value ofDouble(double D) { Value V; V.D = D; return V; }
+    static Value ofFloat(float F) { Value V; V.U = 0; V.F = F; return V; }
+};
+
+// Opcodes, with the operands they use. A is always the destination register.
+// i: integers, d: double, f: float
+#define INTERP_OPCODES(X) \
+    X(loadk)   /* A = Constants[B | C << 8] */ \
+    X(iadd) X(isub) X(imul) X(iand) X(ior) X(ixor) /* A = B op C */ \
+    X(sdiv) X(udiv) X(srem) X(urem) \
+    X(ineg) X(inot) /* A = op B */ \
+    X(ieq) X(ine) X(islt) X(isle) X(isgt) X(isge) X(iult) X(iule) X(iugt) X(iuge) \
+    X(dadd) X(dsub) X(dmul) X(ddiv) X(drem) X(dneg) \
+    X(fadd) X(fsub) X(fmul) X(fdiv) X(frem) X(fneg) \
+    X(dult) X(dule) X(dugt) X(duge) X(dueq) X(dune) /* unordered compares */ \
+    X(si2d) X(ui2d) X(si2f) X(ui2f) X(f2d) /* A = convert B */ \
+    X(sext8) X(sext16) X(sext32) X(zext1) X(zext8) X(zext16) X(zext32) \
+    X(call)    /* A = Calls[B | C << 8](...) */ \
+    X(ret)     /* return A */
+
+enum Opcode : uint8_t {
+#define INTERP_OPCODE_ENUM(name) bc_##name,
+    INTERP_OPCODES(INTERP_OPCODE_ENUM)
+#undef INTERP_OPCODE_ENUM
+};
+
+struct Instr {
+    uint8_t Op;
+    uint8_t A, B, C;
+};
+
+/// CallSite - A call into a function that has already been JIT'd.
+struct CallSite {
+    uint64_t Addr;
+    DataType ReturnType;
+    bool DoubleArgs; // All arguments are doubles, otherwise all are integers
+    std::vector<uint8_t> Args;
+};
+
+const unsigned MaxRegisters = 256;
+const unsigned MaxCallArgs = 6;
+
+/// Chunk - The bytecode for one top-level expression.
+struct Chunk {
+    std::vector<Instr> Code;
+    std::vector<Value> Constants;
+    std::vector<CallSite> Calls;
+};
+
+/// Compiler - Emits register bytecode for the expression nodes. Every method
+/// returns the register holding the result, or -1 if the construct has to
+/// be left to LLVM.
+class Compiler {
+    Chunk &Out;
+    std::vector<DataType> RegTypes;
+    // Registers loaded straight from a constant, with their value
+    std::vector<std::pair<bool, Value>> RegConstants;
+
+    int newReg(DataType dtype);
+    int emit(Opcode Op, DataType dtype, int B, int C = 0);
+    int normalize(int Reg, DataType dtype);
+
+public:
+    Compiler(Chunk &Out) : Out(Out) {}
+
+    int constant(DataType dtype, Value V);
+    int convert(int Reg, DataType From, DataType To);
+    int binary(int Op, DataType dtype, DataType LT, int L, DataType RT, int R);
+    int unary(int Op, DataType dtype, int Reg);
+    int call(const std::string &Callee,
+            const std::vector<std::pair<int, DataType>> &Args, DataType ReturnType);
+    bool ret(int Reg);
+};
+
+/// Run - Interpret a chunk and return its result.
+Value Run(const Chunk &C);
+
+/// Normalize - Extend the low bits of an integer result to the canonical
+/// 64 bit form for dtype.
+Value Normalize(Value V, DataType dtype);
+
+}
+
+#endif
@@ -0,0 +1,283 @@
+#include "./bytecode.h"
+#include "../AST.h"
+#include "../datatype.h"
+#include "../lexer.h"
+#include "../codegen/CG_internal.h"
+#include "../../include/QuailJIT.h"
+#include "llvm/Support/Error.h"
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Interp {
+
+int Compiler::newReg(DataType dtype) {
+    if (RegTypes.size() >= MaxRegisters)
+        return -1;
+    RegTypes.push_back(dtype);
+    RegConstants.push_back({false, Value::ofUInt(0)});
+    return RegTypes.size() - 1;
+}
+
+int Compiler::emit(Opcode Op, DataType dtype, int B, int C) {
+    int A = newReg(dtype);
+    if (A < 0)
+        return -1;
+    Out.Code.push_back({Op, (uint8_t)A, (uint8_t)B, (uint8_t)C});
+    return A;
+}
+
+int Compiler::normalize(int Reg, DataType dtype) {
+    if (Reg < 0)
+        return -1;
+    switch (dtype) {
+    case type_bool:
+        return emit(bc_zext1, dtype, Reg);
+    case type_i8:
+        return emit(bc_sext8, dtype, Reg);
+    case type_i16:
+        return emit(bc_sext16, dtype, Reg);
+    case type_i32:
+        return emit(bc_sext32, dtype, Reg);
+    case type_u8:
+        return emit(bc_zext8, dtype, Reg);
+    case type_u16:
+        return emit(bc_zext16, dtype, Reg);
+    case type_u32:
+        return emit(bc_zext32, dtype, Reg);
+    default:
+        return Reg;
+    }
+}
+
+int Compiler::constant(DataType dtype, Value V) {
+    unsigned Index = Out.Constants.size();
+    if (Index > UINT16_MAX)
+        return -1;
+    Out.Constants.push_back(V);
+    int A = emit(bc_loadk, dtype, Index & 0xff, Index >> 8);
+    if (A >= 0)
+        RegConstants[A] = {true, V};
+    return A;
+}
+
+/// convert - The same expansions as CG::BinOps::expandDataType
+int Compiler::convert(int Reg, DataType From, DataType To) {
+    if (From == To)
+        return Reg;
+    if (To == type_double) {
+        if (From == type_float)
+            return emit(bc_f2d, To, Reg);
+        return emit(isSigned(From) ? bc_si2d : bc_ui2d, To, Reg);
+    }
+    if (To == type_float)
+        return emit(isSigned(From) ? bc_si2f : bc_ui2f, To, Reg);
+    // Integers are already stored extended
+    return Reg;
+}
+
+/// binary - Op on L and R, both converted to dtype first.
+int Compiler::binary(int Op, DataType dtype, DataType LT, int L, DataType RT, int R) {
+    if (dtype == type_UNDECIDED || dtype == type_void)
+        return -1;
+    L = convert(L, LT, dtype);
+    R = convert(R, RT, dtype);
+    if (L < 0 || R < 0)
+        return -1;
+
+    if (dtype == type_double || dtype == type_float) {
+        bool D = dtype == type_double;
+        switch (Op) {
+        case '+':
+            return emit(D ? bc_dadd : bc_fadd, dtype, L, R);
+        case '-':
+            return emit(D ? bc_dsub : bc_fsub, dtype, L, R);
+        case '*':
+            return emit(D ? bc_dmul : bc_fmul, dtype, L, R);
+        case '/':
+            return emit(D ? bc_ddiv : bc_fdiv, dtype, L, R);
+        case '%':
+            return emit(D ? bc_drem : bc_frem, dtype, L, R);
+        default:
+            break;
+        }
+
+        // Floats compare exactly the same once widened to double
+        if (!D) {
+            L = emit(bc_f2d, type_double, L);
+            R = emit(bc_f2d, type_double, R);
+            if (L < 0 || R < 0)
+                return -1;
+        }
+        switch (Op) {
+        case '<':
+            return emit(bc_dult, type_bool, L, R);
+        case '>':
+            return emit(bc_dugt, type_bool, L, R);
+        case op_eq:
+            return emit(bc_dueq, type_bool, L, R);
+        case op_geq:
+            return emit(bc_duge, type_bool, L, R);
+        case op_leq:
+            return emit(bc_dule, type_bool, L, R);
+        case op_neq:
+            return emit(bc_dune, type_bool, L, R);
+        default:
+            return -1;
+        }
+    }
+
+    bool S = isSigned(dtype);
+    switch (Op) {
+    case '+':
+        return normalize(emit(bc_iadd, dtype, L, R), dtype);
+    case '-':
+        return normalize(emit(bc_isub, dtype, L, R), dtype);
+    case '*':
+        return normalize(emit(bc_imul, dtype, L, R), dtype);
+    case '|':
+        return emit(bc_ixor, dtype, L, R);
+    case op_or:
+        return emit(bc_ior, dtype, L, R);
+    case '&':
+        return emit(bc_iand, dtype, L, R);
+    case '/':
+    case '%': {
+        // Only divisions that can not trap are interpreted, the rest keeps
+        // whatever behaviour the native code has.
+        if (!RegConstants[R].first || RegConstants[R].second.U == 0 ||
+                (S && RegConstants[R].second.I == -1))
+            return -1;
+        if (Op == '/')
+            return normalize(emit(S ? bc_sdiv : bc_udiv, dtype, L, R), dtype);
+        return normalize(emit(S ? bc_srem : bc_urem, dtype, L, R), dtype);
+    }
+    case '<':
+        return emit(S ? bc_islt : bc_iult, type_bool, L, R);
+    case '>':
+        return emit(S ? bc_isgt : bc_iugt, type_bool, L, R);
+    case op_eq:
+        return emit(bc_ieq, type_bool, L, R);
+    case op_geq:
+        return emit(S ? bc_isge : bc_iuge, type_bool, L, R);
+    case op_leq:
+        return emit(S ? bc_isle : bc_iule, type_bool, L, R);
+    case op_neq:
+        return emit(bc_ine, type_bool, L, R);
+    default:
+        // User defined operators are left to LLVM
+        return -1;
+    }
+}
+
+int Compiler::unary(int Op, DataType dtype, int Reg) {
+    switch (Op) {
+    case '-':
+        if (dtype == type_double)
+            return emit(bc_dneg, dtype, Reg);
+        if (dtype == type_float)
+            return emit(bc_fneg, dtype, Reg);
+        return normalize(emit(bc_ineg, dtype, Reg), dtype);
+    case '!':
+        if (isFP(dtype))
+            return -1;
+        return normalize(emit(bc_inot, dtype, Reg), dtype);
+    default:
+        return -1;
+    }
+}
+
+int Compiler::call(const std::string &Callee,
+        const std::vector<std::pair<int, DataType>> &Args, DataType ReturnType) {
+    if (Args.size() > MaxCallArgs || Out.Calls.size() > UINT16_MAX)
+        return -1;
+
+    // Only calls where every argument goes in the same kind of register can
+    // be made through a plain function pointer.
+    CallSite Site;
+    Site.DoubleArgs = !Args.empty() && Args[0].second == type_double;
+    for (auto &Arg : Args) {
+        if (Site.DoubleArgs ? Arg.second != type_double : !(Arg.second == type_bool || isInt(Arg.second)))
+            return -1;
+        Site.Args.push_back(Arg.first);
+    }
+
+    auto Sym = CG::TheJIT->lookup(Callee);
+    if (!Sym) {
+        llvm::consumeError(Sym.takeError());
+        return -1;
+    }
+    Site.Addr = Sym->getAddress().getValue();
+    Site.ReturnType = ReturnType;
+
+    unsigned Index = Out.Calls.size();
+    Out.Calls.push_back(std::move(Site));
+    return emit(bc_call, ReturnType, Index & 0xff, Index >> 8);
+}
+
+bool Compiler::ret(int Reg) {
+    if (Reg < 0)
+        return false;
+    Out.Code.push_back({bc_ret, (uint8_t)Reg, 0, 0});
+    return true;
+}
+
+}
+
+namespace AST {
+
+int Tree::bytecode(Interp::Compiler &C, NodeRef Ref) const {
+    const Node &N = Nodes[Ref];
+    switch (N.Kind) {
+    case node_number:
+        if (N.Type == type_double)
+            return C.constant(type_double, Interp::Value::ofDouble(N.real()));
+        if (N.Type == type_float)
+            return C.constant(type_float, Interp::Value::ofFloat(N.real()));
+        // Integers are already sign or zero extended to 64 bits
+        return C.constant(N.Type, Interp::Value::ofUInt(N.bits()));
+    case node_line:
+        // A line that does not return leaves nothing to print
+        if (!N.Flags)
+            return -1;
+        return bytecode(C, N.A);
+    case node_binary: {
+        // Assignments need variables, which only exist in compiled code
+        if (N.A == '=')
+            return -1;
+        int L = bytecode(C, N.B);
+        if (L < 0)
+            return -1;
+        int R = bytecode(C, N.C);
+        if (R < 0)
+            return -1;
+        return C.binary(N.A, (DataType)N.Flags, Nodes[N.B].Type, L, Nodes[N.C].Type, R);
+    }
+    case node_unary: {
+        int Reg = bytecode(C, N.B);
+        if (Reg < 0)
+            return -1;
+        return C.unary(N.A, Nodes[N.B].Type, Reg);
+    }
+    case node_call: {
+        std::vector<std::pair<int, DataType>> ArgRegs;
+        for (NodeRef Arg : list(N.B)) {
+            int Reg = bytecode(C, Arg);
+            if (Reg < 0)
+                return -1;
+            ArgRegs.push_back({Reg, Nodes[Arg].Type});
+        }
+        return C.call(Identifiers.name(N.A), ArgRegs, N.Type);
+    }
+    default:
+        return -1;
+    }
+}
+
+bool FunctionAST::bytecode(Interp::Chunk &Out) {
+    Interp::Compiler C(Out);
+    return C.ret(Nodes.bytecode(C, Body));
+}
+
+}
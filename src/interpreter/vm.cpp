@@ -0,0 +1,189 @@
+#include "./bytecode.h"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// Threaded dispatch jumps straight from one handler to the next. Compilers
+// without label addresses fall back to a switch.
+#if defined(__GNUC__) || defined(__clang__)
+#define INTERP_COMPUTED_GOTO
+#endif
+
+namespace Interp {
+
+template <typename R, typename A, size_t... I>
+static R invoke(uint64_t Addr, const A *Args, std::index_sequence<I...>) {
+    using Fn = R (*)(decltype((void)I, A())...);
+    return reinterpret_cast<Fn>(Addr)(Args[I]...);
+}
+
+template <typename R, typename A>
+static R invokeN(uint64_t Addr, const A *Args, size_t N) {
+    switch (N) {
+    case 0: return invoke<R, A>(Addr, Args, std::make_index_sequence<0>());
+    case 1: return invoke<R, A>(Addr, Args, std::make_index_sequence<1>());
+    case 2: return invoke<R, A>(Addr, Args, std::make_index_sequence<2>());
+    case 3: return invoke<R, A>(Addr, Args, std::make_index_sequence<3>());
+    case 4: return invoke<R, A>(Addr, Args, std::make_index_sequence<4>());
+    case 5: return invoke<R, A>(Addr, Args, std::make_index_sequence<5>());
+    default: return invoke<R, A>(Addr, Args, std::make_index_sequence<6>());
+    }
+}
+
+template <typename A>
+static Value callAs(const CallSite &Site, const A *Args) {
+    size_t N = Site.Args.size();
+    switch (Site.ReturnType) {
+    case type_double:
+        return Value::ofDouble(invokeN<double>(Site.Addr, Args, N));
+    case type_float:
+        return Value::ofFloat(invokeN<float>(Site.Addr, Args, N));
+    case type_void:
+        invokeN<void>(Site.Addr, Args, N);
+        return Value::ofUInt(0);
+    default:
+        // Only the low bits of a narrow return value are defined
+        return Normalize(Value::ofInt(invokeN<int64_t>(Site.Addr, Args, N)),
+                Site.ReturnType);
+    }
+}
+
+static Value callNative(const CallSite &Site, const Value *R) {
+    if (Site.DoubleArgs) {
+        double Args[MaxCallArgs];
+        for (size_t i = 0; i < Site.Args.size(); i++)
+            Args[i] = R[Site.Args[i]].D;
+        return callAs(Site, Args);
+    }
+    int64_t Args[MaxCallArgs];
+    for (size_t i = 0; i < Site.Args.size(); i++)
+        Args[i] = R[Site.Args[i]].I;
+    return callAs(Site, Args);
+}
+
+Value Normalize(Value V, DataType dtype) {
+    switch (dtype) {
+    case type_bool:
+        return Value::ofUInt(V.U & 1);
+    case type_i8:
+        return Value::ofInt((int8_t)V.I);
+    case type_i16:
+        return Value::ofInt((int16_t)V.I);
+    case type_i32:
+        return Value::ofInt((int32_t)V.I);
+    case type_u8:
+        return Value::ofUInt((uint8_t)V.U);
+    case type_u16:
+        return Value::ofUInt((uint16_t)V.U);
+    case type_u32:
+        return Value::ofUInt((uint32_t)V.U);
+    default:
+        return V;
+    }
+}
+
+Value Run(const Chunk &C) {
+    Value R[MaxRegisters];
+    const Instr *IP = C.Code.data();
+
+#ifdef INTERP_COMPUTED_GOTO
+    static const void *Targets[] = {
+#define INTERP_OPCODE_TARGET(name) &&do_##name,
+        INTERP_OPCODES(INTERP_OPCODE_TARGET)
+#undef INTERP_OPCODE_TARGET
+    };
+#define TARGET(name) do_##name:
+#define DISPATCH() goto *Targets[IP->Op]
+#else
+#define TARGET(name) case bc_##name:
+#define DISPATCH() goto dispatch
+#endif
+#define NEXT() do { ++IP; DISPATCH(); } while (0)
+#define A_ R[IP->A]
+#define B_ R[IP->B]
+#define C_ R[IP->C]
+
+#ifdef INTERP_COMPUTED_GOTO
+    DISPATCH();
+#else
+dispatch:
+    switch (IP->Op) {
+#endif
+    TARGET(loadk)  A_ = C.Constants[IP->B | IP->C << 8]; NEXT();
+
+    TARGET(iadd)   A_.U = B_.U + C_.U; NEXT();
+    TARGET(isub)   A_.U = B_.U - C_.U; NEXT();
+    TARGET(imul)   A_.U = B_.U * C_.U; NEXT();
+    TARGET(iand)   A_.U = B_.U & C_.U; NEXT();
+    TARGET(ior)    A_.U = B_.U | C_.U; NEXT();
+    TARGET(ixor)   A_.U = B_.U ^ C_.U; NEXT();
+    TARGET(sdiv)   A_.I = B_.I / C_.I; NEXT();
+    TARGET(udiv)   A_.U = B_.U / C_.U; NEXT();
+    TARGET(srem)   A_.I = B_.I % C_.I; NEXT();
+    TARGET(urem)   A_.U = B_.U % C_.U; NEXT();
+    TARGET(ineg)   A_.U = 0 - B_.U; NEXT();
+    TARGET(inot)   A_.U = ~B_.U; NEXT();
+
+    TARGET(ieq)    A_.U = B_.U == C_.U; NEXT();
+    TARGET(ine)    A_.U = B_.U != C_.U; NEXT();
+    TARGET(islt)   A_.U = B_.I < C_.I; NEXT();
+    TARGET(isle)   A_.U = B_.I <= C_.I; NEXT();
+    TARGET(isgt)   A_.U = B_.I > C_.I; NEXT();
+    TARGET(isge)   A_.U = B_.I >= C_.I; NEXT();
+    TARGET(iult)   A_.U = B_.U < C_.U; NEXT();
+    TARGET(iule)   A_.U = B_.U <= C_.U; NEXT();
+    TARGET(iugt)   A_.U = B_.U > C_.U; NEXT();
+    TARGET(iuge)   A_.U = B_.U >= C_.U; NEXT();
+
+    TARGET(dadd)   A_.D = B_.D + C_.D; NEXT();
+    TARGET(dsub)   A_.D = B_.D - C_.D; NEXT();
+    TARGET(dmul)   A_.D = B_.D * C_.D; NEXT();
+    TARGET(ddiv)   A_.D = B_.D / C_.D; NEXT();
+    TARGET(drem)   A_.D = std::fmod(B_.D, C_.D); NEXT();
+    TARGET(dneg)   A_.D = -B_.D; NEXT();
+    TARGET(fadd)   A_ = Value::ofFloat(B_.F + C_.F); NEXT();
+    TARGET(fsub)   A_ = Value::ofFloat(B_.F - C_.F); NEXT();
+    TARGET(fmul)   A_ = Value::ofFloat(B_.F * C_.F); NEXT();
+    TARGET(fdiv)   A_ = Value::ofFloat(B_.F / C_.F); NEXT();
+    TARGET(frem)   A_ = Value::ofFloat(std::fmod(B_.F, C_.F)); NEXT();
+    TARGET(fneg)   A_ = Value::ofFloat(-B_.F); NEXT();
+
+    // Unordered: true if either side is NaN, like the fcmp u* predicates
+    TARGET(dult)   A_.U = !(B_.D >= C_.D); NEXT();
+    TARGET(dule)   A_.U = !(B_.D > C_.D); NEXT();
+    TARGET(dugt)   A_.U = !(B_.D <= C_.D); NEXT();
+    TARGET(duge)   A_.U = !(B_.D < C_.D); NEXT();
+    TARGET(dueq)   A_.U = !(B_.D < C_.D || B_.D > C_.D); NEXT();
+    TARGET(dune)   A_.U = !(B_.D == C_.D); NEXT();
+
+    TARGET(si2d)   A_.D = (double)B_.I; NEXT();
+    TARGET(ui2d)   A_.D = (double)B_.U; NEXT();
+    TARGET(si2f)   A_ = Value::ofFloat((float)B_.I); NEXT();
+    TARGET(ui2f)   A_ = Value::ofFloat((float)B_.U); NEXT();
+    TARGET(f2d)    A_.D = (double)B_.F; NEXT();
+
+    TARGET(sext8)  A_.I = (int8_t)B_.I; NEXT();
+    TARGET(sext16) A_.I = (int16_t)B_.I; NEXT();
+    TARGET(sext32) A_.I = (int32_t)B_.I; NEXT();
+    TARGET(zext1)  A_.U = B_.U & 1; NEXT();
+    TARGET(zext8)  A_.U = (uint8_t)B_.U; NEXT();
+    TARGET(zext16) A_.U = (uint16_t)B_.U; NEXT();
+    TARGET(zext32) A_.U = (uint32_t)B_.U; NEXT();
+
+    TARGET(call)   A_ = callNative(C.Calls[IP->B | IP->C << 8], R); NEXT();
+    TARGET(ret)    return A_;
+#ifndef INTERP_COMPUTED_GOTO
+    }
+    return Value::ofUInt(0);
+#endif
+
+#undef TARGET
+#undef DISPATCH
+#undef NEXT
+#undef A_
+#undef B_
+#undef C_
+}
+
+}
@@ -0,0 +1,140 @@
+#ifndef KEYWORDS
+#define KEYWORDS
+
+#include "datatype.h"
+#include "lexer.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/// Keywords - Reserved words and type names, recognized with a perfect hash
+/// that is built at compile time. New keywords only need a row in Words (or
+/// TypeSuffixes); the build fails if no collision free hash can be found.
+namespace Keywords {
+
+struct Entry {
+    std::string_view Name;
+    int Token;
+    DataType Type; // For tok_dtype and number suffixes
+};
+
+constexpr Entry Words[] = {
+    {"def", tok_def, type_UNDECIDED},
+    {"extern", tok_extern, type_UNDECIDED},
+    {"if", tok_if, type_UNDECIDED},
+    {"else", tok_else, type_UNDECIDED},
+    {"for", tok_for, type_UNDECIDED},
+    {"while", tok_while, type_UNDECIDED},
+    {"flee", tok_flee, type_UNDECIDED},
+    {"operator", tok_operator, type_UNDECIDED},
+    {"true", tok_true, type_UNDECIDED},
+    {"false", tok_false, type_UNDECIDED},
+    {"double", tok_dtype, type_double},
+    {"float", tok_dtype, type_float},
+    {"bool", tok_dtype, type_bool},
+    {"i64", tok_dtype, type_i64},
+    {"i32", tok_dtype, type_i32},
+    {"i16", tok_dtype, type_i16},
+    {"i8", tok_dtype, type_i8},
+    {"u64", tok_dtype, type_u64},
+    {"u32", tok_dtype, type_u32},
+    {"u16", tok_dtype, type_u16},
+    {"u8", tok_dtype, type_u8},
+    {"void", tok_dtype, type_void},
+};
+
+/// TypeSuffixes - The types a number can be given with "10:u8"
+constexpr Entry TypeSuffixes[] = {
+    {"i64", tok_number, type_i64},
+    {"i32", tok_number, type_i32},
+    {"i16", tok_number, type_i16},
+    {"i8", tok_number, type_i8},
+    {"u64", tok_number, type_u64},
+    {"u32", tok_number, type_u32},
+    {"u16", tok_number, type_u16},
+    {"u8", tok_number, type_u8},
+    {"d", tok_number, type_double},
+    {"f", tok_number, type_float},
+};
+
+// Only the length and the first, second and last characters are hashed.
+constexpr unsigned hash(std::string_view Word, unsigned Seed, unsigned Mask) {
+    unsigned H = Seed;
+    H = H * 33 ^ (unsigned)Word.size();
+    H = H * 33 ^ (unsigned char)Word[0];
+    H = H * 33 ^ (unsigned char)Word[Word.size() - 1];
+    if (Word.size() > 1)
+        H = H * 33 ^ (unsigned char)Word[1];
+    return (H ^ (H >> 7)) & Mask;
+}
+
+constexpr unsigned tableSize(size_t N) {
+    unsigned Size = 1;
+    while (Size < 2 * N)
+        Size *= 2;
+    return Size;
+}
+
+template <unsigned Size>
+struct Table {
+    unsigned Seed = 0; // 0 if no perfect hash was found
+    std::array<int8_t, Size> Slots{};
+};
+
+template <size_t N>
+constexpr Table<tableSize(N)> buildTable(const Entry (&Entries)[N]) {
+    constexpr unsigned Size = tableSize(N);
+    Table<Size> T;
+    for (unsigned Seed = 1; Seed < 100000; Seed++) {
+        for (auto &Slot : T.Slots)
+            Slot = -1;
+        bool Collision = false;
+        for (size_t i = 0; i < N && !Collision; i++) {
+            unsigned H = hash(Entries[i].Name, Seed, Size - 1);
+            Collision = T.Slots[H] != -1;
+            T.Slots[H] = i;
+        }
+        if (!Collision) {
+            T.Seed = Seed;
+            return T;
+        }
+    }
+    T.Seed = 0;
+    return T;
+}
+
+constexpr auto WordTable = buildTable(Words);
+constexpr auto SuffixTable = buildTable(TypeSuffixes);
+static_assert(WordTable.Seed != 0, "Keywords::Words has no collision free hash");
+static_assert(SuffixTable.Seed != 0, "Keywords::TypeSuffixes has no collision free hash");
+
+template <size_t N, unsigned Size>
+constexpr const Entry *lookup(std::string_view Word, const Entry (&Entries)[N],
+        const Table<Size> &T) {
+    if (Word.empty())
+        return nullptr;
+    int Index = T.Slots[hash(Word, T.Seed, Size - 1)];
+    if (Index < 0 || Entries[Index].Name != Word)
+        return nullptr;
+    return &Entries[Index];
+}
+
+/// find - The keyword or type name Word, or null for plain identifiers.
+constexpr const Entry *find(std::string_view Word) {
+    return lookup(Word, Words, WordTable);
+}
+
+/// findSuffix - The type named by a number suffix, or null.
+constexpr const Entry *findSuffix(std::string_view Word) {
+    return lookup(Word, TypeSuffixes, SuffixTable);
+}
+
+static_assert(find("u8") && find("u8")->Type == type_u8);
+static_assert(find("operator") && find("operator")->Token == tok_operator);
+static_assert(!find("u9") && !find("define") && !find("i"));
+static_assert(findSuffix("d") && findSuffix("d")->Type == type_double);
+
+}
+
+#endif
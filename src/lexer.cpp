@@ -1,65 +1,137 @@
 #include "./lexer.h"
 #include "./BinopsData.h"
+#include "./keywords.h"
+#include "./source.h"
+#include "./scan.h"
 #include "datatype.h"
+#include <algorithm>
 #include <cassert>
 #include <cctype>
+#include <charconv>
+#include <cmath>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
-#include <fstream>
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <thread>
 
-std::string fileData;
-int index = 0;
+// LexerState - One lexer's position in its input, and the payload of the
+// token it found last. The parser reads from Main, and parallel lexing runs
+// one per chunk.
+struct LexerState {
+    std::string_view Data;
+    size_t Index = 0;
+    char LastChar = ' ';
+    size_t TokStart = 0; // Offset of the last token
+    std::string_view Identifier;
+    double Num = 0;
+    int64_t INum = 0;
+    // Not reset between tokens, a number with an unknown type suffix keeps
+    // the type of the token lexed before it.
+    DataType dtype = type_void;
+    // Set when Data is read from a stream, which is pulled in a line at a
+    // time. Depth counts the '(' and '{' still open.
+    SourceBuffer *Stream = nullptr;
+    int Depth = 0;
+};
+
+// Tokens are slices of Main.Data, which SourceMgr keeps alive until the
+// lexer is reset.
+static unsigned CurBuffer = 0;
+static LexerState Main;
 bool jitMode;
 
+// Tokens lexed but not yet taken by the parser. With Pretokenize this holds
+// the whole input.
+static TokenStream Tokens;
+static bool Pretokenize = false;
+static unsigned LexThreads = 0;
+static void lexAll();
+
 
-void initBuffer() {
+bool initBuffer() {
     jitMode = true;
-    index = 0;
-    std::getline(std::cin, fileData);
+    Main.Index = 0;
+    std::unique_ptr<SourceBuffer> Source = SourceBuffer::fromStream(std::cin);
+    if (!Source->readLine())
+        return false;
+    Main.Stream = Source.get();
+    CurBuffer = SourceMgr.addBuffer("<stdin>", std::move(Source));
+    Main.Data = SourceMgr.text(CurBuffer);
+    if (Pretokenize)
+        lexAll();
     getNextToken();
+    return true;
 }
 
 void readFile(char* filepath) {
     jitMode = false;
-    index = 0;
-    std::ifstream file(filepath);
-    std::string str;
-    while (std::getline(file, str)) {
-        fileData += str; 
-        fileData.push_back('\n'); 
+    Main.Index = 0;
+    std::string name = filepath;
+    std::unique_ptr<SourceBuffer> Source;
+    if (name == "-") {
+        // Lexing starts as soon as the first line arrives
+        Source = SourceBuffer::fromStream(std::cin);
+        Main.Stream = Source.get();
+        name = "<stdin>";
     }
+    else
+        Source = SourceBuffer::fromFile(filepath);
+    if (!Source)
+        Source = SourceBuffer::fromString("");
+    CurBuffer = SourceMgr.addBuffer(name, std::move(Source));
+    Main.Data = SourceMgr.text(CurBuffer);
+    if (Pretokenize)
+        lexAll();
     getNextToken();
 }
 
-location lex_location;
-char nextChar() {
-    if (index >= fileData.size()) {
+static char nextChar(LexerState &L) {
+    // Step past the end as well, so the last character read is always at
+    // Index - 1.
+    if (L.Index >= L.Data.size()) {
+        L.Index = L.Data.size() + 1;
         return EOF;
     }
-    char c = fileData[index++];
-    if (c == '\n'){
-        lex_location.line += 1;
-        lex_location.col = 1;
-    }
-    else
-        lex_location.col += 1;
-    return c;
+    return L.Data[L.Index++];
+}
+
+// skipTo - Jump ahead to pos, past a run found by one of the scanners. Lines
+// and columns are not tracked here, getLexPos works them out from offsets.
+static void skipTo(LexerState &L, size_t pos) {
+    L.Index = pos;
 }
 
 
 // The lexer returns tokens [0-255] if it is an unknown character, otherwise
 // one of these for known things. It returns tokens greater than 255 for
 // multi-part operators
-std::string IdentifierStr; //Filled in if tok_identifier
+std::string_view IdentifierStr; //Filled in if tok_identifier
+Symbol IdentifierSym;             //Filled in if tok_identifier
 double NumVal;             //Filled in if tok_number
 int64_t INumVal;             //Filled in if tok_number
 DataType TokenDataType;
 
+// Operators of up to four characters are their characters packed into the
+// token, first character lowest. Longer ones are numbered instead, with a
+// zero low byte that no packed operator has.
+static std::vector<std::string> LongOperatorNames;
+
 int optok(std::string op) {
-    return (op[1] << 8) + op[0];
+    if (op.size() <= 4) {
+        int tok = 0;
+        for (size_t i = op.size(); i-- > 0;)
+            tok = (tok << 8) + (unsigned char)op[i];
+        return tok;
+    }
+    auto it = std::find(LongOperatorNames.begin(), LongOperatorNames.end(), op);
+    if (it == LongOperatorNames.end())
+        it = LongOperatorNames.insert(it, op);
+    return (it - LongOperatorNames.begin() + 1) << 8;
 }
 
 std::string tokop(int op) {
@@ -95,210 +167,511 @@ std::string tokop(int op) {
                 return std::to_string(op);
         }
     }
+    if ((op & 0xff) == 0 && (size_t)(op >> 8) <= LongOperatorNames.size())
+        return LongOperatorNames[(op >> 8) - 1];
     std::string ret;
-    ret += (char)(op);
-    char second = op >> 8;
-    if (second != 0) {
-        ret += second;
-    }
+    for (; op != 0; op >>= 8)
+        ret += (char)(op & 0xff);
     return ret;
 }
 
-// gettok - Return the next token from the standard input.
-static char LastChar = ' ';
-int gettok() {
-    //Skip any white space
-    while (isspace(LastChar))
-        LastChar = nextChar();
-
-    if (isalpha(LastChar) || LastChar == '_') {
-        IdentifierStr = LastChar;
-        while (isalnum((LastChar = nextChar())) || LastChar == '_')
-            IdentifierStr += LastChar;
-
-        if (IdentifierStr == "def")
-            return tok_def;
-        else if (IdentifierStr == "extern")
-            return tok_extern;
-        else if (IdentifierStr == "if")
-            return tok_if;
-        else if (IdentifierStr == "else")
-            return tok_else;
-        else if (IdentifierStr == "for")
-            return tok_for;
-        else if (IdentifierStr == "while")
-            return tok_while;
-        else if (IdentifierStr == "flee")
-            return tok_flee;
-        else if (IdentifierStr == "operator")
-            return tok_operator;
-        else if (IdentifierStr == "double"){
-            TokenDataType = type_double;
-            return tok_dtype;
-        }
-        else if (IdentifierStr == "float"){
-            TokenDataType = type_float;
-            return tok_dtype;
-        }
-        else if (IdentifierStr == "bool"){
-            TokenDataType = type_bool;
-            return tok_dtype;
-        }
-        else if (IdentifierStr == "i64"){
-            TokenDataType = type_i64;
-            return tok_dtype;
-        }
-        else if (IdentifierStr == "i32"){
-            TokenDataType = type_i32;
-            return tok_dtype;
-        }
-        else if (IdentifierStr == "i16"){
-            TokenDataType = type_i16;
-            return tok_dtype;
-        }
-        else if (IdentifierStr == "i8"){
-            TokenDataType = type_i8;
-            return tok_dtype;
+// digitValue - The value of c as a digit, or 36 if it is not one.
+static unsigned digitValue(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'z')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A' + 10;
+    return 36;
+}
+
+// lexNumber - Read the literal starting at L.LastChar into L.Num and L.INum,
+// and return the type it has without a suffix. Literals are decimal, or 0x
+// and 0b integers, and a '_' can separate any two digits.
+static DataType lexNumber(LexerState &L) {
+    const char *Data = L.Data.data();
+    size_t Size = L.Data.size();
+    size_t start = L.Index - 1;
+
+    unsigned Base = 10;
+    if (Data[start] == '0' && start + 2 < Size) {
+        char Prefix = Data[start + 1] | 0x20;
+        unsigned PrefixBase = Prefix == 'x' ? 16 : Prefix == 'b' ? 2 : 10;
+        if (PrefixBase != 10 && digitValue(Data[start + 2]) < PrefixBase)
+            Base = PrefixBase;
+    }
+
+    // Integer digits are accumulated as they are found. Overflowing
+    // decimals saturate like strtoll, 0x and 0b literals at 64 bits.
+    uint64_t Value = 0;
+    bool Overflow = false;
+    bool Underscores = false;
+    size_t end = Base == 10 ? start : start + 2;
+    size_t intEnd = std::string_view::npos; // Position of the '.'
+    while (true) {
+        if (Base == 10) {
+            size_t runEnd = scanNumber(Data, end, Size);
+            for (size_t i = end; i < runEnd && intEnd == std::string_view::npos; i++) {
+                if (Data[i] == '.') {
+                    intEnd = i;
+                    break;
+                }
+                unsigned d = Data[i] - '0';
+                Overflow |= Value > (UINT64_MAX - d) / 10;
+                Value = Value * 10 + d;
+            }
+            end = runEnd;
         }
-        else if (IdentifierStr == "u64"){
-            TokenDataType = type_u64;
-            return tok_dtype;
+        else {
+            for (unsigned d; end < Size && (d = digitValue(Data[end])) < Base; end++) {
+                Overflow |= Value > (UINT64_MAX - d) / Base;
+                Value = Value * Base + d;
+            }
         }
-        else if (IdentifierStr == "u32"){
-            TokenDataType = type_u32;
-            return tok_dtype;
+        if (end + 1 < Size && Data[end] == '_' && digitValue(Data[end + 1]) < Base) {
+            Underscores = true;
+            end++;
+            continue;
         }
-        else if (IdentifierStr == "u16"){
-            TokenDataType = type_u16;
-            return tok_dtype;
+        break;
+    }
+    skipTo(L, end);
+    L.LastChar = nextChar(L);
+
+    if (Base != 10) {
+        if (Overflow)
+            Value = UINT64_MAX;
+        L.INum = (int64_t)Value;
+        L.Num = (double)Value;
+        if (Value > INT64_MAX)
+            return type_u64;
+        return (int32_t)L.INum == L.INum ? type_i32 : type_i64;
+    }
+
+    bool isInt = intEnd == std::string_view::npos;
+    L.INum = Overflow || Value > INT64_MAX ? INT64_MAX : (int64_t)Value;
+    if (isInt && !Overflow) {
+        // Converting the exact integer rounds the same way strtod does
+        L.Num = (double)Value;
+        return (int32_t)L.INum == L.INum ? type_i32 : type_i64;
+    }
+
+    // The rest goes to from_chars, without the separators
+    char Buffer[128];
+    std::string Long;
+    const char *first = Data + start;
+    const char *last = Data + end;
+    if (Underscores) {
+        char *Out = Buffer;
+        if (end - start > sizeof(Buffer)) {
+            Long.resize(end - start);
+            Out = Long.data();
         }
-        else if (IdentifierStr == "u8"){
-            TokenDataType = type_u8;
-            return tok_dtype;
+        first = Out;
+        for (size_t i = start; i < end; i++) {
+            if (Data[i] != '_')
+                *Out++ = Data[i];
         }
-        else if (IdentifierStr == "void"){
-            TokenDataType = type_void;
-            return tok_dtype;
+        last = Out;
+    }
+    L.Num = 0;
+    if (std::from_chars(first, last, L.Num).ec == std::errc::result_out_of_range) {
+        // Match strtod: too large becomes infinity, too small becomes 0
+        bool large = false;
+        for (const char *c = first; c != last && *c != '.'; c++)
+            large |= *c != '0';
+        L.Num = large ? HUGE_VAL : 0.0;
+    }
+    if (isInt)
+        return type_i64;
+    return (float)L.Num == L.Num ? type_float : type_double;
+}
+
+// pullLine - Read another line of L's stream, once the lexer has reached the
+// end of what it has. Lines end in a newline, so no token is cut in two. At
+// the prompt a line only continues onto the next while a '(' or '{' is open.
+static bool pullLine(LexerState &L) {
+    if (jitMode) {
+        if (L.Depth <= 0)
+            return false;
+        std::cout << "... " << std::flush;
+    }
+    size_t End = L.Data.size();
+    if (!L.Stream->readLine())
+        return false;
+    L.Data = L.Stream->text();
+    L.Index = End;
+    L.LastChar = nextChar(L);
+    return true;
+}
+
+// lex - Return the next token from L's input.
+static int lex(LexerState &L) {
+    //Skip any white space
+    if (isspace(L.LastChar)) {
+        skipTo(L, scanWhitespace(L.Data.data(), L.Index, L.Data.size()));
+        L.LastChar = nextChar(L);
+    }
+    L.TokStart = L.Index - 1;
+
+    if (isalpha(L.LastChar) || L.LastChar == '_') {
+        size_t start = L.Index - 1;
+        skipTo(L, scanIdentifier(L.Data.data(), L.Index, L.Data.size()));
+        L.LastChar = nextChar(L);
+        L.Identifier = L.Data.substr(start, L.Index - 1 - start);
+
+        if (const Keywords::Entry *Word = Keywords::find(L.Identifier)) {
+            if (Word->Token == tok_dtype)
+                L.dtype = Word->Type;
+            return Word->Token;
         }
-        else if (IdentifierStr == "true")
-            return tok_true;
-        else if (IdentifierStr == "false")
-            return tok_false;
 
         return tok_identifier;
     }
 
-    if (isdigit(LastChar) || LastChar == '.') {
-        std::string NumStr;
-        std::string INumStr;
-        bool isInt = true;
-        do {
-            if (LastChar == '.')
-                isInt = false;
-            if (isInt)
-                INumStr += LastChar;
-            NumStr += LastChar;
-            LastChar = nextChar();
-        } while (isdigit(LastChar) || LastChar == '.');
-
-
-        NumVal = strtod(NumStr.c_str(), 0);
-        INumVal = strtoll(INumStr.c_str(), 0, 10);
-        if (LastChar == ':'){
-            LastChar = nextChar();
-            std::string ExplicitType;
+    if (isdigit(L.LastChar) || L.LastChar == '.') {
+        DataType Inferred = lexNumber(L);
+        if (L.LastChar == ':'){
+            L.LastChar = nextChar(L);
+            size_t typeStart = L.Index - 1;
             do {
-                ExplicitType += LastChar;
-                LastChar = nextChar();
+                L.LastChar = nextChar(L);
+                // The suffix can go on into the next line, see splitPoint
+                if (L.LastChar == EOF && L.Stream)
+                    pullLine(L);
             } 
-            while(isdigit(LastChar) || LastChar == 'i' || LastChar == 'f' || LastChar == 'd');
-            if (ExplicitType == "i64")
-                TokenDataType = type_i64;
-            if (ExplicitType == "i32")
-                TokenDataType = type_i32;
-            if (ExplicitType == "i16")
-                TokenDataType = type_i16;
-            if (ExplicitType == "i8")
-                TokenDataType = type_i8;
-            if (ExplicitType == "u64")
-                TokenDataType = type_u64;
-            if (ExplicitType == "u32")
-                TokenDataType = type_u32;
-            if (ExplicitType == "u16")
-                TokenDataType = type_u16;
-            if (ExplicitType == "u8")
-                TokenDataType = type_u8;
-            if (ExplicitType == "d")
-                TokenDataType = type_double;
-            if (ExplicitType == "f")
-                TokenDataType = type_float;
-        }
-        else {
-            if (isInt){
-                if ((int32_t)INumVal == INumVal){
-                    TokenDataType = type_i32; 
-                } else {
-                    TokenDataType = type_i64; 
-                }
-            }
-            else {
-                if ((float)NumVal == NumVal){
-                    TokenDataType = type_float;
-                } else {
-                    TokenDataType = type_double;
-                }
-                
-            }
+            while(isdigit(L.LastChar) || L.LastChar == 'i' || L.LastChar == 'f' || L.LastChar == 'd');
+            std::string_view ExplicitType = L.Data.substr(typeStart, L.Index - 1 - typeStart);
+            if (const Keywords::Entry *Suffix = Keywords::findSuffix(ExplicitType))
+                L.dtype = Suffix->Type;
         }
+        else
+            L.dtype = Inferred;
         return tok_number;
     }
 
-    if (LastChar == '#') {
-        do
-            LastChar = nextChar();
-        while (LastChar != EOF && LastChar != '\n' && LastChar != '\r');
+    if (L.LastChar == '#') {
+        skipTo(L, scanComment(L.Data.data(), L.Index, L.Data.size()));
+        L.LastChar = nextChar(L);
 
-        if (LastChar != EOF)
-            return gettok();
+        if (L.LastChar != EOF)
+            return lex(L);
     }
 
     // Check for end of file
-    if (LastChar == EOF)
+    if (L.LastChar == EOF) {
+        if (L.Stream && pullLine(L))
+            return lex(L);
         return tok_eof;
+    }
 
-    // Otherwise, just return the character as its ascii value.
-    char ThisChar = LastChar;
-    LastChar = nextChar();
-
-    // But first, check to make sure it isnt a multipart operator
-    int value = (LastChar << 8) + ThisChar;
-    for (int val = 0; val < longops.size(); val++) {
-        if (longops[val] == value) {
-            LastChar = nextChar();
-            return value;
-        }
+    // Check for the longest multipart operator starting here
+    size_t length;
+    if (int op = longops.match(L.Data, L.Index - 1, length)) {
+        skipTo(L, L.Index - 1 + length);
+        L.LastChar = nextChar(L);
+        return op;
     }
 
+    // Otherwise, just return the character as its ascii value.
+    char ThisChar = L.LastChar;
+    if (L.Stream)
+        L.Depth += (ThisChar == '(' || ThisChar == '{') - (ThisChar == ')' || ThisChar == '}');
+    L.LastChar = nextChar(L);
     return ThisChar;
 }
 
+int gettok() {
+    int Kind = lex(Main);
+    IdentifierStr = Main.Identifier;
+    NumVal = Main.Num;
+    INumVal = Main.INum;
+    TokenDataType = Main.dtype;
+    return Kind;
+}
+
+void TokenStream::clear() {
+    Kinds.clear();
+    Offsets.clear();
+    Payloads.clear();
+    Numbers.clear();
+    Next = 0;
+    LexedLongops = 0;
+}
+
+void setPretokenize(bool enable) {
+    Pretokenize = enable;
+}
+
+void setLexThreads(unsigned threads) {
+    LexThreads = threads;
+}
+
+// lexToken - Append the next token from L to Out.
+static int lexToken(LexerState &L, TokenStream &Out) {
+    int Kind = lex(L);
+    uint32_t Payload = 0;
+    if (Kind == tok_number) {
+        Payload = Out.Numbers.size();
+        Out.Numbers.push_back({L.Num, L.INum, L.dtype});
+    }
+    else if (Kind < 0 && Kind != tok_eof)
+        Payload = L.Identifier.size();
+    Out.Kinds.push_back(Kind);
+    Out.Offsets.push_back((uint32_t)L.TokStart);
+    Out.Payloads.push_back(Payload);
+    return Kind;
+}
+
+// fill - Lex until the stream holds token i, or ends in tok_eof.
+static bool fill(size_t i) {
+    while (i >= Tokens.size()) {
+        if (!Tokens.size())
+            Tokens.LexedLongops = longops.size();
+        else if (Tokens.Kinds.back() == tok_eof)
+            return false;
+        lexToken(Main, Tokens);
+    }
+    return true;
+}
+
+// tokenAt - The token at stream entry i, and how many entries it covers.
+// Operators can be defined while parsing, so operators the lexer split up
+// before it knew them are joined here. longops only ever grows.
+static size_t tokenAt(size_t i, int &Kind) {
+    Kind = Tokens.Kinds[i];
+    if (Kind <= 0 || longops.size() == Tokens.LexedLongops)
+        return 1;
+    size_t Start = Tokens.Offsets[i];
+    size_t Length = 0;
+    int Op = longops.match(Main.Data, Start, Length);
+    if (!Op || Op == Kind)
+        return 1;
+
+    // The operator has to be made of whole tokens
+    size_t End = Start + Length;
+    size_t j = i;
+    while (fill(j + 1) && Tokens.Offsets[j + 1] < End) {
+        j++;
+        if (Tokens.Kinds[j] <= 0)
+            return 1;
+    }
+    if (Tokens.Offsets[j] + tokop(Tokens.Kinds[j]).size() != End)
+        return 1;
+    Kind = Op;
+    return j - i + 1;
+}
+
 int CurTok;
+static uint32_t CurOffset = 0;
 int getNextToken() {
-    return CurTok = gettok();
+    // Without pretokenizing the stream only holds lookahead. Once the parser
+    // has caught up with it, tokens come straight from gettok again.
+    if (Tokens.Next >= Tokens.size() && !Pretokenize) {
+        if (Tokens.size())
+            Tokens.clear();
+        CurTok = gettok();
+        CurOffset = Main.TokStart;
+        if (CurTok == tok_identifier)
+            IdentifierSym = Identifiers.intern(IdentifierStr);
+        return CurTok;
+    }
+    size_t i = std::min(Tokens.Next, Tokens.size() - 1);
+    Tokens.Next = i + tokenAt(i, CurTok);
+    CurOffset = Tokens.Offsets[i];
+
+    if (CurTok == tok_number) {
+        const TokenStream::Number &N = Tokens.Numbers[Tokens.Payloads[i]];
+        NumVal = N.Val;
+        INumVal = N.IVal;
+        TokenDataType = N.dtype;
+    }
+    else if (CurTok < 0 && CurTok != tok_eof) {
+        IdentifierStr = Main.Data.substr(CurOffset, Tokens.Payloads[i]);
+        if (CurTok == tok_identifier)
+            IdentifierSym = Identifiers.intern(IdentifierStr);
+        else if (CurTok == tok_dtype)
+            TokenDataType = Keywords::find(IdentifierStr)->Type;
+    }
+    return CurTok;
+}
+
+int peekTok(unsigned n) {
+    if (n == 0)
+        return CurTok;
+    size_t i = Tokens.Next;
+    int Kind = tok_eof;
+    for (unsigned k = 0; k < n; k++) {
+        if (!fill(i))
+            return tok_eof;
+        i += tokenAt(i, Kind);
+    }
+    return Kind;
+}
+
+static void reserveTokens(TokenStream &Out, size_t bytes) {
+    // Roughly one token per four bytes of source
+    size_t Estimate = bytes / 4 + 1;
+    Out.Kinds.reserve(Estimate);
+    Out.Offsets.reserve(Estimate);
+    Out.Payloads.reserve(Estimate);
+}
+
+// Chunks smaller than this are not worth a thread
+static const size_t MinChunkBytes = 256 * 1024;
+
+// splitPoint - The first line start at or after pos where a fresh lexer
+// finds the same tokens as one that lexed everything before it, or npos.
+// No token continues past a newline, except for a number suffix whose ':'
+// ends the line. Comments end at the newline as well.
+static size_t splitPoint(std::string_view Data, size_t pos) {
+    while ((pos = Data.find('\n', pos)) != std::string_view::npos) {
+        pos++;
+        if (pos < 2 || Data[pos - 2] != ':')
+            return pos;
+    }
+    return std::string_view::npos;
+}
+
+// lexChunk - Lex Data from Begin to its end into Out. Numbers that take
+// their type from before the chunk are left type_UNDECIDED, and Last is the
+// type the next chunk would inherit, type_UNDECIDED if nothing set one.
+static void lexChunk(std::string_view Data, size_t Begin, TokenStream &Out, DataType &Last) {
+    LexerState L;
+    L.Data = Data;
+    L.Index = Begin;
+    L.dtype = type_UNDECIDED;
+    reserveTokens(Out, Data.size() - Begin);
+    while (lexToken(L, Out) != tok_eof)
+        ;
+    Last = L.dtype;
+}
+
+// lexAll - Lex the rest of the input into the stream in one go. Large
+// inputs are split at line starts and the pieces lexed in parallel.
+static void lexAll() {
+    std::string_view Data = Main.Data;
+    unsigned Threads = LexThreads ? LexThreads : std::thread::hardware_concurrency();
+    size_t Chunks = std::min<size_t>(std::max(Threads, 1u), Data.size() / MinChunkBytes);
+    Tokens.LexedLongops = longops.size();
+
+    std::vector<size_t> Starts = {Main.Index};
+    for (size_t c = 1; c < Chunks; c++) {
+        size_t pos = splitPoint(Data, std::max(Starts.back(), Data.size() * c / Chunks));
+        if (pos >= Data.size())
+            break;
+        Starts.push_back(pos);
+    }
+    if (Starts.size() == 1) {
+        reserveTokens(Tokens, Data.size());
+        while (lexToken(Main, Tokens) != tok_eof)
+            ;
+        return;
+    }
+    Starts.push_back(Data.size());
+
+    size_t N = Starts.size() - 1;
+    std::vector<TokenStream> Parts(N);
+    std::vector<DataType> Last(N);
+    std::vector<std::thread> Workers;
+    for (size_t c = 1; c < N; c++)
+        Workers.emplace_back(lexChunk, Data.substr(0, Starts[c + 1]), Starts[c],
+                std::ref(Parts[c]), std::ref(Last[c]));
+    lexChunk(Data.substr(0, Starts[1]), Starts[0], Parts[0], Last[0]);
+    for (std::thread &Worker : Workers)
+        Worker.join();
+
+    // Only the last chunk really ends the input, and numbers at the start
+    // of a chunk get the type the chunks before it left behind.
+    DataType Carry = Main.dtype;
+    size_t Total = 0;
+    for (size_t c = 0; c < N; c++) {
+        TokenStream &Part = Parts[c];
+        if (c + 1 < N) {
+            Part.Kinds.pop_back();
+            Part.Offsets.pop_back();
+            Part.Payloads.pop_back();
+        }
+        for (TokenStream::Number &Num : Part.Numbers) {
+            if (Num.dtype != type_UNDECIDED)
+                break;
+            Num.dtype = Carry;
+        }
+        if (Last[c] != type_UNDECIDED)
+            Carry = Last[c];
+        Total += Part.size();
+    }
+
+    // Every chunk copies itself into place in the joined stream
+    std::vector<size_t> TokenBase(N), NumberBase(N);
+    for (size_t c = 1; c < N; c++) {
+        TokenBase[c] = TokenBase[c - 1] + Parts[c - 1].size();
+        NumberBase[c] = NumberBase[c - 1] + Parts[c - 1].Numbers.size();
+    }
+    Tokens.Kinds.resize(Total);
+    Tokens.Offsets.resize(Total);
+    Tokens.Payloads.resize(Total);
+    Tokens.Numbers.resize(NumberBase[N - 1] + Parts[N - 1].Numbers.size());
+    auto copyPart = [&](size_t c) {
+        TokenStream &Part = Parts[c];
+        for (size_t i = 0; i < Part.size(); i++) {
+            if (Part.Kinds[i] == tok_number)
+                Part.Payloads[i] += NumberBase[c];
+        }
+        std::copy(Part.Kinds.begin(), Part.Kinds.end(), Tokens.Kinds.begin() + TokenBase[c]);
+        std::copy(Part.Offsets.begin(), Part.Offsets.end(), Tokens.Offsets.begin() + TokenBase[c]);
+        std::copy(Part.Payloads.begin(), Part.Payloads.end(), Tokens.Payloads.begin() + TokenBase[c]);
+        std::copy(Part.Numbers.begin(), Part.Numbers.end(), Tokens.Numbers.begin() + NumberBase[c]);
+        Part = TokenStream();
+    };
+    Workers.clear();
+    for (size_t c = 1; c < N; c++)
+        Workers.emplace_back(copyPart, c);
+    copyPart(0);
+    for (std::thread &Worker : Workers)
+        Worker.join();
+
+    // Leave Main where the sequential lexer would have stopped
+    Main.Index = Data.size() + 1;
+    Main.LastChar = EOF;
+    Main.dtype = Carry;
+}
+
+void dropConsumedInput() {
+    // Pretokenized tokens cover all of the input, so it is kept whole
+    if (!Main.Stream || Pretokenize)
+        return;
+    size_t Dropped = SourceMgr.discard(CurBuffer, CurOffset);
+    if (!Dropped)
+        return;
+
+    // Everything still needed lies after the cut, and moved down with it
+    Main.Data = SourceMgr.text(CurBuffer);
+    Main.Index -= Dropped;
+    Main.TokStart -= Dropped;
+    Main.Identifier = std::string_view();
+    CurOffset -= Dropped;
+    for (size_t i = Tokens.Next; i < Tokens.size(); i++)
+        Tokens.Offsets[i] -= Dropped;
+    if (CurTok < 0 && CurTok != tok_eof && CurTok != tok_number)
+        IdentifierStr = Main.Data.substr(CurOffset, IdentifierStr.size());
 }
 
 location getLexPos() {
-    return lex_location;
+    if (Main.Data.data() == nullptr)
+        return {1, 1, location::NoBuffer};
+    return SourceMgr.getLocation(CurBuffer, CurOffset);
 }
 
 void resetLexer() {
-    fileData = "";
-    LastChar = ' ';
+    SourceMgr.clear();
+    Main = LexerState();
     CurTok = ' ';
     IdentifierStr = "";
     NumVal = 0;
     INumVal = 0;
-    lex_location.line = 1;
-    lex_location.col = 1;
     TokenDataType = type_void;
+    Tokens.clear();
+    CurOffset = 0;
 }
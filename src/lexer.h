@@ -2,7 +2,11 @@
 #define LEXER
 
 #include "datatype.h"
+#include "source.h"
+#include "symbols.h"
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 
 enum Token {
@@ -42,28 +46,64 @@ enum Token {
     
 };
 
-struct location {
-    int line;
-    int col;
-};
-
 int optok(std::string op);
 std::string tokop(int op);
 
-extern std::string IdentifierStr; //Filled in if tok_identifier
+extern std::string_view IdentifierStr; //Filled in if tok_identifier
+extern Symbol IdentifierSym;      //Filled in if tok_identifier, by getNextToken
 extern double NumVal;             //Filled in if tok_number
 extern int64_t INumVal;             //Filled in if tok_number
 extern DataType TokenDataType;
 
 int gettok();
 
+/// TokenStream - Lexed tokens waiting for the parser, one column per field.
+/// Payload is the length of identifiers and keywords, or the index into
+/// Numbers for tok_number.
+struct TokenStream {
+    struct Number {
+        double Val;
+        int64_t IVal;
+        DataType dtype;
+    };
+
+    std::vector<int> Kinds;
+    std::vector<uint32_t> Offsets;
+    std::vector<uint32_t> Payloads;
+    std::vector<Number> Numbers;
+    size_t Next = 0; // First token the parser has not taken
+    size_t LexedLongops = 0; // longops.size() when the first token was lexed
+
+    size_t size() const { return Kinds.size(); }
+    void clear();
+};
+
 extern int CurTok;
 int getNextToken();
 
+/// peekTok - The token n places after CurTok, without consuming anything.
+int peekTok(unsigned n = 1);
+
+/// setPretokenize - Lex each input completely before parsing starts,
+/// instead of one token at a time.
+void setPretokenize(bool enable);
+
+/// setLexThreads - Threads used to pretokenize large inputs, 0 for one per
+/// core.
+void setLexThreads(unsigned threads);
+
 void resetLexer();
-void initBuffer();
+/// initBuffer - Start lexing a line from stdin, which goes on for more lines
+/// while brackets are open. Returns false once stdin has ended.
+bool initBuffer();
+/// readFile - Start lexing filepath, or all of stdin for "-".
 void readFile(char* filepath);
 
+/// dropConsumedInput - Free the lines of a stream before the current token.
+/// Called between top-level items, when nothing refers back to them.
+void dropConsumedInput();
+
+/// getLexPos - Where the current token starts, for diagnostics.
 location getLexPos();
 
 #endif
@@ -7,27 +7,30 @@
 using namespace AST;
 
 std::string strLexPos() {
-    location pos = getLexPos(); 
-    return "Line: " + std::to_string(pos.line) + " Col: " + std::to_string(pos.col);
+    location pos = getLexPos();
+    std::string str = "Line: " + std::to_string(pos.line) + " Col: " + std::to_string(pos.col);
+    if (pos.buffer == location::NoBuffer || SourceMgr.name(pos.buffer).empty())
+        return str;
+    return "File: " + SourceMgr.name(pos.buffer) + " " + str;
 }
 
 /// LogError* - These are little helper funcions for error handling.
-std::unique_ptr<ExprAST> LogError(std::string Str) {
+NodeRef LogError(std::string Str) {
     std::cout << "Error: " << Str << "\n" << strLexPos() << "\n";
     throw CompileError();
-    return nullptr;
+    return NoNode;
 }
 
-std::unique_ptr<ExprAST> LogErrorParse(std::string Str) {
+NodeRef LogErrorParse(std::string Str) {
     std::cout << "Syntax Error: " << Str << "\n" << strLexPos() << "\n";
     throw CompileError();
-    return nullptr;
+    return NoNode;
 }
 
-std::unique_ptr<ExprAST> LogErrorCompile(std::string Str) {
+NodeRef LogErrorCompile(std::string Str) {
     std::cout << "Compile Error: " << Str << "\n";
     throw CompileError();
-    return nullptr;
+    return NoNode;
 }
 
 std::unique_ptr<PrototypeAST> LogErrorP(std::string Str) {
@@ -1,23 +1,24 @@
 #ifndef LOGGING
 #define LOGGING
 
+#include <cstdint>
 #include <memory>
 #include <string>
 namespace llvm {
     class Value;
 };
 namespace AST {
-    class ExprAST;
     class PrototypeAST;
+    typedef uint32_t NodeRef;
 }
 
 
-std::unique_ptr<AST::ExprAST> LogError(std::string Str);
+AST::NodeRef LogError(std::string Str);
 std::unique_ptr<AST::PrototypeAST> LogErrorP(std::string Str);
 llvm::Value *LogErrorV(std::string Str);
-std::unique_ptr<AST::ExprAST> LogErrorParse(std::string Str);
+AST::NodeRef LogErrorParse(std::string Str);
 std::unique_ptr<AST::PrototypeAST> LogErrorParseP(std::string Str);
-std::unique_ptr<AST::ExprAST> LogErrorCompile(std::string Str);
+AST::NodeRef LogErrorCompile(std::string Str);
 llvm::Value *LogErrorCompileV(std::string Str);
 llvm::Value *LogCompilerBug(std::string Str);
 
@@ -1,13 +1,19 @@
 #include "./output.h"
 #include "./logging.h"
 #include "./codegen/CG_internal.h"
+#include "./codegen/objectcache.h"
+#include "./codegen/optimizations.h"
 
 #include <filesystem>
 
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/Module.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Config/llvm-config.h"
 #include "llvm/MC/TargetRegistry.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Target/TargetMachine.h"
@@ -31,8 +37,8 @@ void SaveToObjectFile(std::string filename) {
         FileOutputError(Error);
     }
 
-    auto CPU = "generic";
-    auto Features = "";
+    std::string CPU = CG::TargetCPU;
+    std::string Features = join(CG::TargetFeatures, ",");
 
     TargetOptions opt;
     auto TargetMachine = Target->createTargetMachine(TargetTriple, CPU, Features, opt, Reloc::PIC_);
@@ -47,14 +53,33 @@ void SaveToObjectFile(std::string filename) {
         FileOutputError("Could not open file: " + EC.message());
     }
 
+    std::unique_ptr<CG::DiskObjectCache> Cache;
+    if (!CG::ObjectCacheDir.empty()) {
+        Cache = std::make_unique<CG::DiskObjectCache>(CG::ObjectCacheDir,
+            std::string("LLVM " LLVM_VERSION_STRING "\n") + TargetTriple + "\n" + CPU + "\n" +
+            Features + "\naot -O" + std::to_string(GetLevel()));
+        if (auto Obj = Cache->getObject(CG::TheModule.get())) {
+            dest << Obj->getBuffer();
+            dest.flush();
+            DebugLog(std::string("'") + filename + "' loaded from the object cache");
+            return;
+        }
+    }
+
     legacy::PassManager pass;
     auto FileType = CodeGenFileType::ObjectFile;
 
-    if (TargetMachine->addPassesToEmitFile(pass, dest, nullptr, FileType)) {
+    // Emit into memory first, so the object can be stored in the cache too
+    SmallVector<char, 0> ObjBuffer;
+    raw_svector_ostream ObjStream(ObjBuffer);
+    if (TargetMachine->addPassesToEmitFile(pass, ObjStream, nullptr, FileType)) {
         FileOutputError("TargetMachine can't emit a file of this type");
     }
 
     pass.run(*CG::TheModule);
+    if (Cache)
+        Cache->notifyObjectCompiled(CG::TheModule.get(), MemoryBufferRef(StringRef(ObjBuffer.data(), ObjBuffer.size()), filename));
+    dest << StringRef(ObjBuffer.data(), ObjBuffer.size());
     dest.flush();
     DebugLog(std::string("'") + filename + "' compiled succesfully");
 }
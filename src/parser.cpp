@@ -4,6 +4,7 @@
 #include "./logging.h"
 #include "./lexer.h"
 #include "./AST.h"
+#include "./symbols.h"
 #include <cctype>
 #include <cstdint>
 #include <cstdio>
@@ -17,87 +18,84 @@
 using namespace AST;
 
 /// CurTok/getNextToken - Provide a simple token buffer. CurTok is the current
-/// token the parser is looking at. getNextToken reads another token from the
-/// lexer and updates CurTok with its results.
-static std::map<std::string, DataType> NamedValuesDatatype;
-static std::map<std::string, std::pair<DataType, std::vector<DataType>>> FunctionDataTypes;
-
-
-static std::unique_ptr<ExprAST> ParseExpression();
-
-static std::unique_ptr<ExprAST> ParseNumberExpr() {
-    if (TokenDataType == type_double){
-        auto Result = std::make_unique<DoubleExprAST>(NumVal);
-        getNextToken(); // consume the number
-        return Result;
-    } 
-    else if (TokenDataType == type_float){
-        auto Result = std::make_unique<FloatExprAST>((float)NumVal);
-        getNextToken(); // consume the number
-        return Result;
-    } 
-    else if (TokenDataType == type_i64){
-        auto Result = std::make_unique<I64ExprAST>((int64_t)INumVal);
-        getNextToken(); // consume the number
-        return Result;
-    }
-    else if (TokenDataType == type_i32){
-        auto Result = std::make_unique<I32ExprAST>((int32_t)INumVal);
-        getNextToken(); // consume the number
-        return Result;
-    }
-    else if (TokenDataType == type_i16){
-        auto Result = std::make_unique<I16ExprAST>((int16_t)INumVal);
-        getNextToken(); // consume the number
-        return Result;
-    }
-    else if (TokenDataType == type_i8){
-        auto Result = std::make_unique<I8ExprAST>((int8_t)INumVal);
-        getNextToken(); // consume the number
-        return Result;
-    }
-    else if (TokenDataType == type_u64){
-        auto Result = std::make_unique<U64ExprAST>((uint64_t)INumVal);
-        getNextToken(); // consume the number
-        return Result;
-    }
-    else if (TokenDataType == type_u32){
-        auto Result = std::make_unique<U32ExprAST>((uint32_t)INumVal);
-        getNextToken(); // consume the number
-        return Result;
-    }
-    else if (TokenDataType == type_u16){
-        auto Result = std::make_unique<U16ExprAST>((uint16_t)INumVal);
-        getNextToken(); // consume the number
-        return Result;
-    }
-    else if (TokenDataType == type_u8){
-        auto Result = std::make_unique<U8ExprAST>((uint8_t)INumVal);
-        getNextToken(); // consume the number
-        return Result;
-    }
-
-    return LogErrorParse("Invalid datatype: " + std::to_string(TokenDataType));
+/// token the parser is looking at. getNextToken takes the next token from the
+/// lexer's token stream and updates CurTok with its results, and peekTok looks
+/// further ahead without consuming anything.
+static ScopedSymbolMap<DataType> NamedValuesDatatype;
+static SymbolMap<std::pair<DataType, std::vector<DataType>>> FunctionDataTypes;
+
+
+/// Nodes - The tree the definition being parsed adds its nodes to.
+static Tree *Nodes = nullptr;
+
+static DataType typeOf(NodeRef N) {
+    return (*Nodes)[N].Type;
+}
+
+static bool lineReturns(NodeRef Line) {
+    return (*Nodes)[Line].Flags;
+}
+
+static NodeRef ParseExpression();
+
+static NodeRef ParseNumberExpr() {
+    NodeRef Result;
+    switch (TokenDataType) {
+    case type_double:
+        Result = Nodes->real(type_double, NumVal);
+        break;
+    case type_float:
+        Result = Nodes->real(type_float, (float)NumVal);
+        break;
+    case type_i64:
+        Result = Nodes->integer(type_i64, (int64_t)INumVal);
+        break;
+    case type_i32:
+        Result = Nodes->integer(type_i32, (int32_t)INumVal);
+        break;
+    case type_i16:
+        Result = Nodes->integer(type_i16, (int16_t)INumVal);
+        break;
+    case type_i8:
+        Result = Nodes->integer(type_i8, (int8_t)INumVal);
+        break;
+    case type_u64:
+        Result = Nodes->integer(type_u64, (uint64_t)INumVal);
+        break;
+    case type_u32:
+        Result = Nodes->integer(type_u32, (uint32_t)INumVal);
+        break;
+    case type_u16:
+        Result = Nodes->integer(type_u16, (uint16_t)INumVal);
+        break;
+    case type_u8:
+        Result = Nodes->integer(type_u8, (uint8_t)INumVal);
+        break;
+    default:
+        return LogErrorParse("Invalid datatype: " + std::to_string(TokenDataType));
+    }
+    getNextToken(); // consume the number
+    return Result;
 }
 
-static std::unique_ptr<ExprAST> ParseBoolExpr() {
-    auto Result = std::make_unique<BoolExprAST>(CurTok == tok_true);
+static NodeRef ParseBoolExpr() {
+    NodeRef Result = Nodes->integer(type_bool, CurTok == tok_true);
     getNextToken(); // Consume the truth statement
-    return std::move(Result);
+    return Result;
 }
 
-static std::unique_ptr<ExprAST> ParseParenExpr() {
+static NodeRef ParseParenExpr() {
     getNextToken(); // eat (.
     auto V = ParseExpression();
     if (!V)
-        return nullptr;
+        return NoNode;
     if (CurTok != ')')
         return LogErrorParse("expected ')'. Got '" + tokop(CurTok) + "'");
     getNextToken(); //eat ).
     return V;
 }
 
-static std::unique_ptr<LineAST> ParseLine() {
+static NodeRef ParseLine() {
     bool returns = true;
     // Prevent double semicolon possibility
     if (CurTok == tok_def || CurTok == tok_for || CurTok == tok_if || CurTok == tok_extern) {
@@ -109,57 +107,56 @@ static std::unique_ptr<LineAST> ParseLine() {
         getNextToken(); // Eat ;
         returns = false;
     }
-    return std::make_unique<LineAST>(std::move(body), returns);
+    return Nodes->line(body, returns);
 }
 
 struct ParserBlockStackData {
     DataType blockDtype = type_UNDECIDED;
-    std::map<std::string, DataType> outerVariables;
-    std::vector<std::string> localVariables;
 };
 static std::vector<ParserBlockStackData*> ParseBlockStack;
-static int BS_index = -1;
-static std::unique_ptr<BlockAST> ParseBlock() {
+
+/// ResetScopes - Forget every variable and block, including any left behind
+/// when an error unwound the previous definition.
+static void ResetScopes() {
+    NamedValuesDatatype.clear();
+    ParseBlockStack.clear();
+}
+
+static NodeRef ParseBlock() {
     if (CurTok != '{'){
         LogErrorParse("expected '{'. Got '" + tokop(CurTok) + "'");
-        return nullptr;
+        return NoNode;
     }
     getNextToken(); // Eat {
 
-    std::vector<std::unique_ptr<LineAST>> lines;
+    std::vector<NodeRef> lines;
     ParserBlockStackData data = ParserBlockStackData();
     ParseBlockStack.push_back(&data);
-    BS_index += 1;
+    NamedValuesDatatype.enterScope();
     while (CurTok != '}') {
-        std::unique_ptr<LineAST> line = ParseLine();
-        if(line->getReturns()) {
+        NodeRef line = ParseLine();
+        if(lineReturns(line)) {
             if (data.blockDtype == type_UNDECIDED)
-                data.blockDtype = line->getDatatype();
-            else if (data.blockDtype != line->getDatatype()){
+                data.blockDtype = typeOf(line);
+            else if (data.blockDtype != typeOf(line)){
                 LogErrorParse("Block can not have multiple return types. " +
                         dtypeToString(data.blockDtype) + " and " + 
-                        dtypeToString(line->getDatatype()) + " are both returned");
-                return nullptr;
+                        dtypeToString(typeOf(line)) + " are both returned");
+                return NoNode;
             }
         }
-        lines.push_back(std::move(line));
+        lines.push_back(line);
     }
     ParseBlockStack.pop_back();
-    BS_index -= 1;
     getNextToken(); // Eat '}'
     // Remove all local variables from scope
-    for (int i = 0; i < data.localVariables.size(); i++){
-        if(data.outerVariables.count(data.localVariables[i]) != 0)
-            NamedValuesDatatype[data.localVariables[i]] = data.outerVariables[data.localVariables[i]];
-        else
-            NamedValuesDatatype.erase(data.localVariables[i]);
-    }
+    NamedValuesDatatype.exitScope();
     if (data.blockDtype == type_UNDECIDED)
         data.blockDtype = type_void;
-    return std::make_unique<BlockAST>(std::move(lines), data.blockDtype);
+    return Nodes->block(lines, data.blockDtype);
 }
 
-static std::unique_ptr<ExprAST> ParseFleeExpr() {
+static NodeRef ParseFleeExpr() {
     if(ParseBlockStack.empty()) 
         return LogErrorParse("Flee instruction must be contained within block");
     getNextToken(); // Eat flee
@@ -170,7 +167,7 @@ static std::unique_ptr<ExprAST> ParseFleeExpr() {
             return LogErrorParse("expected integer constant within flee. Got '" + tokop(CurTok) + "'");
         if (!isInt(TokenDataType))
             return LogErrorParse("expected integer constant within flee. Got '" + dtypeToString(TokenDataType) + "' type instead");
-        if( INumVal > BS_index || INumVal < 0){
+        if( INumVal >= ParseBlockStack.size() || INumVal < 0){
             return LogErrorParse("Flee distance should be within range (0 ~ " + std::to_string(fleeAmmount) + 
                     "). Got '" + std::to_string(INumVal) + "' type instead");
         }
@@ -188,17 +185,17 @@ static std::unique_ptr<ExprAST> ParseFleeExpr() {
             return LogErrorParse("flee["+ std::to_string(fleeAmmount) +"] statement's return type '" + dtypeToString(type_void) +
                     "' differs from the target block return type of '" + dtypeToString(ParseBlockStack[fleeAmmount]->blockDtype) + "'");
 
-        return std::make_unique<FleeAST>(nullptr, fleeAmmount);
+        return Nodes->flee(NoNode, fleeAmmount);
     }
 
-    std::unique_ptr<ExprAST> body = ParseExpression();
+    NodeRef body = ParseExpression();
     if(!body)
-        return nullptr;
+        return NoNode;
 
     if(CurTok != ';')
         return LogErrorParse("Flee statement should end with ';'. Got '" + tokop(CurTok) + "'");
 
-    DataType dtype = body->getDatatype();
+    DataType dtype = typeOf(body);
 
     if (ParseBlockStack[fleeAmmount]->blockDtype == type_UNDECIDED)
         ParseBlockStack[fleeAmmount]->blockDtype = dtype;
@@ -206,41 +203,43 @@ static std::unique_ptr<ExprAST> ParseFleeExpr() {
         return LogErrorParse("flee["+ std::to_string(fleeAmmount) +"] statement's return type '" + dtypeToString(dtype) +
                 "' differs from the target block return type of '" + dtypeToString(ParseBlockStack[fleeAmmount]->blockDtype) + "'");
 
-    return std::make_unique<FleeAST>(std::move(body), fleeAmmount);
+    return Nodes->flee(body, fleeAmmount);
 }
 
-static std::unique_ptr<ExprAST> ParseIdentifierExpr() {
-    std::string IdName = IdentifierStr;
+static NodeRef ParseIdentifierExpr() {
+    Symbol IdName = IdentifierSym;
 
     getNextToken(); // eat identifier.
     if (CurTok != '('){ // Simple variable ref.
-        if (NamedValuesDatatype.count(IdName) == 0){
-            return LogErrorParse("Variable '" + IdName + "' does not exist!");
+        DataType *dtype = NamedValuesDatatype.find(IdName);
+        if (!dtype){
+            return LogErrorParse("Variable '" + Identifiers.name(IdName) + "' does not exist!");
         }
-        return std::make_unique<VariableExprAST>(IdName, NamedValuesDatatype[IdName]);
+        return Nodes->variable(IdName, *dtype);
     }
 
     // Call.
     getNextToken(); //eat (
 
-    if (FunctionDataTypes.count(IdName) == 0){
-        return LogErrorParse("Function '" + IdName + "' does not exist!");
+    auto *Signature = FunctionDataTypes.find(IdName);
+    if (!Signature){
+        return LogErrorParse("Function '" + Identifiers.name(IdName) + "' does not exist!");
     }
-    std::vector<DataType> argDtypes = FunctionDataTypes[IdName].second;
+    const std::vector<DataType> &argDtypes = Signature->second;
 
-    std::vector<std::unique_ptr<ExprAST>> Args;
+    std::vector<NodeRef> Args;
     if (CurTok != ')') {
         for (int i = 0; i <= argDtypes.size(); i++) {
             if (auto Arg = ParseExpression()){
-                if (Arg->getDatatype() != argDtypes[i]){
-                    return LogErrorParse("Function '" + IdName + "' contains a type mismatch.\n" + 
+                if (typeOf(Arg) != argDtypes[i]){
+                    return LogErrorParse("Function '" + Identifiers.name(IdName) + "' contains a type mismatch.\n" + 
                             "Argument #" + std::to_string(i) + " requires type '" + dtypeToString(argDtypes[i]) + "'. " +
-                            "Got '" + dtypeToString(Arg->getDatatype()) + "' instead");
+                            "Got '" + dtypeToString(typeOf(Arg)) + "' instead");
                 }
-                Args.push_back(std::move(Arg));
+                Args.push_back(Arg);
             }
             else {
-                return nullptr;
+                return NoNode;
             }
 
             if (CurTok == ')')
@@ -255,15 +254,15 @@ static std::unique_ptr<ExprAST> ParseIdentifierExpr() {
     // Eat the ')'
     if (CurTok != ')'){ // Simple variable ref.
         return LogErrorParse("expected ')'. Got '" + tokop(CurTok) + "'. \n" + 
-                    "Function '" + IdName + "' likely contains too many arguments.");
+                    "Function '" + Identifiers.name(IdName) + "' likely contains too many arguments.");
 
     }
     getNextToken();
 
-    return std::make_unique<CallExprAST>(IdName, std::move(Args), FunctionDataTypes[IdName].first);
+    return Nodes->call(IdName, Args, Signature->first);
 }
 
-static std::unique_ptr<ExprAST> ParseIfExpr() {
+static NodeRef ParseIfExpr() {
     getNextToken(); // eat the if.
 
     if (CurTok != '(')
@@ -273,44 +272,44 @@ static std::unique_ptr<ExprAST> ParseIfExpr() {
     //condition.
     auto Cond = ParseExpression();
     if (!Cond)
-        return nullptr;
+        return NoNode;
 
     if (CurTok != ')')
         return LogErrorParse("expected ')'. Got '" + tokop(CurTok) + "'");
     getNextToken(); // Eat the ')'
 
-    std::unique_ptr<LineAST> Then = ParseLine();
+    NodeRef Then = ParseLine();
     if (!Then)
-        return nullptr;
+        return NoNode;
 
-    if(Then->getReturns() && !ParseBlockStack.empty()) {
-        if (ParseBlockStack[BS_index]->blockDtype == type_UNDECIDED)
-            ParseBlockStack[BS_index]->blockDtype = Then->getDatatype();
-        else if (ParseBlockStack[BS_index]->blockDtype != Then->getDatatype())
-            return LogErrorParse("If statement's return type '" + dtypeToString(Then->getDatatype()) + "' " + 
-                    "differs from the current block return type of '" + dtypeToString(ParseBlockStack[BS_index]->blockDtype) + "'");
+    if(lineReturns(Then) && !ParseBlockStack.empty()) {
+        if (ParseBlockStack.back()->blockDtype == type_UNDECIDED)
+            ParseBlockStack.back()->blockDtype = typeOf(Then);
+        else if (ParseBlockStack.back()->blockDtype != typeOf(Then))
+            return LogErrorParse("If statement's return type '" + dtypeToString(typeOf(Then)) + "' " + 
+                    "differs from the current block return type of '" + dtypeToString(ParseBlockStack.back()->blockDtype) + "'");
     }
 
     if (CurTok == tok_else){
         getNextToken();
-        std::unique_ptr<LineAST> Else = ParseLine();
+        NodeRef Else = ParseLine();
         if (!Else)
-            return nullptr;
-
-        if(Else->getReturns() && !ParseBlockStack.empty()) {
-            if (ParseBlockStack[BS_index]->blockDtype == type_UNDECIDED)
-                ParseBlockStack[BS_index]->blockDtype = Else->getDatatype();
-            else if (ParseBlockStack[BS_index]->blockDtype != Else->getDatatype())
-                return LogErrorParse("If statement's return type '" + dtypeToString(Else->getDatatype()) + "' " + 
-                        "differs from the current block return type of '" + dtypeToString(ParseBlockStack[BS_index]->blockDtype) + "'");
+            return NoNode;
+
+        if(lineReturns(Else) && !ParseBlockStack.empty()) {
+            if (ParseBlockStack.back()->blockDtype == type_UNDECIDED)
+                ParseBlockStack.back()->blockDtype = typeOf(Else);
+            else if (ParseBlockStack.back()->blockDtype != typeOf(Else))
+                return LogErrorParse("If statement's return type '" + dtypeToString(typeOf(Else)) + "' " + 
+                        "differs from the current block return type of '" + dtypeToString(ParseBlockStack.back()->blockDtype) + "'");
         }
 
-        return std::make_unique<IfExprAST>(std::move(Cond), std::move(Then), std::move(Else));
+        return Nodes->ifExpr(Cond, Then, Else);
     }
-    return std::make_unique<IfExprAST>(std::move(Cond), std::move(Then), std::move(nullptr));
+    return Nodes->ifExpr(Cond, Then, NoNode);
 }
 
-static std::unique_ptr<ExprAST> ParseForExpr() {
+static NodeRef ParseForExpr() {
     getNextToken(); // eat the for.
 
     if (CurTok != '(')
@@ -327,31 +326,28 @@ static std::unique_ptr<ExprAST> ParseForExpr() {
     if (CurTok != tok_identifier)
         return LogErrorParse("expected identifier after for. Got '" + tokop(CurTok) + "'");
 
-    std::string IdName = IdentifierStr;
+    Symbol IdName = IdentifierSym;
     getNextToken(); //eat identifier.
 
-    DataType outerDtype = type_UNDECIDED;
-    if (NamedValuesDatatype.count(IdName) != 0){
-        outerDtype = NamedValuesDatatype[IdName];
-    }
-    NamedValuesDatatype[IdName] = indexDtype;
+    NamedValuesDatatype.enterScope();
+    NamedValuesDatatype.bind(IdName, indexDtype);
 
     if (CurTok != '=')
         return LogErrorParse("expected '='. Got '" + tokop(CurTok) + "'");
     getNextToken(); // eat '='.
 
-    std::unique_ptr<ExprAST> Start = ParseExpression();
+    NodeRef Start = ParseExpression();
     if (!Start)
-        return nullptr;
+        return NoNode;
     if (CurTok != ';')
         return LogErrorParse("expected ';'. Got '" + tokop(CurTok) + "'");
     getNextToken();
 
-    std::unique_ptr<ExprAST> End = ParseExpression();
+    NodeRef End = ParseExpression();
     if (!End)
-        return nullptr;
-    if (End->getDatatype() != type_bool){
-        return LogErrorParse("For loop condition should be 'bool' rather than '" + dtypeToString(End->getDatatype()) + "'");
+        return NoNode;
+    if (typeOf(End) != type_bool){
+        return LogErrorParse("For loop condition should be 'bool' rather than '" + dtypeToString(typeOf(End)) + "'");
     }
 
     if (CurTok != ';') {
@@ -359,18 +355,18 @@ static std::unique_ptr<ExprAST> ParseForExpr() {
     }
     getNextToken(); // Eat ;
 
-    std::unique_ptr<ExprAST> Step = ParseExpression();
+    NodeRef Step = ParseExpression();
     if (!Step)
-        return nullptr;
+        return NoNode;
 
     if (CurTok != ')')
         return LogErrorParse("expected ')'. Got '" + tokop(CurTok) + "'");
     getNextToken(); // Eat the ')'
 
 
-    std::unique_ptr<ExprAST> Body = ParseExpression();
+    NodeRef Body = ParseExpression();
     if (!Body)
-        return nullptr;
+        return NoNode;
 
     if (CurTok == ';')
         getNextToken();
@@ -379,27 +375,23 @@ static std::unique_ptr<ExprAST> ParseForExpr() {
                 "for loop statement must end with a ';', because return types are impossible.");
 
     // Restore old bindings to 'i' variable.
-    if (outerDtype != type_UNDECIDED)
-        NamedValuesDatatype[IdName] = outerDtype;
-    else
-        NamedValuesDatatype.erase(IdName);
+    NamedValuesDatatype.exitScope();
 
-    return std::make_unique<ForExprAST>(IdName, indexDtype, std::move(Start),
-                        std::move(End), std::move(Step),std::move(Body));
+    return Nodes->forExpr(IdName, indexDtype, Start, End, Step, Body);
 }
 
-static std::unique_ptr<ExprAST> ParseWhileExpr() {
+static NodeRef ParseWhileExpr() {
     getNextToken(); // eat the while.
 
     if (CurTok != '(')
         return LogErrorParse("expected '('. Got '" + tokop(CurTok) + "'");
     getNextToken(); // Eat the '('
 
-    std::unique_ptr<ExprAST> Condition = ParseExpression();
+    NodeRef Condition = ParseExpression();
     if (!Condition)
-        return nullptr;
-    if (Condition->getDatatype() != type_bool){
-        return LogErrorParse("While loop condition should be 'bool' rather than '" + dtypeToString(Condition->getDatatype()) + "'");
+        return NoNode;
+    if (typeOf(Condition) != type_bool){
+        return LogErrorParse("While loop condition should be 'bool' rather than '" + dtypeToString(typeOf(Condition)) + "'");
     }
 
     if (CurTok != ')')
@@ -407,9 +399,9 @@ static std::unique_ptr<ExprAST> ParseWhileExpr() {
     getNextToken(); // Eat the ')'
 
 
-    std::unique_ptr<ExprAST> Body = ParseExpression();
+    NodeRef Body = ParseExpression();
     if (!Body)
-        return nullptr;
+        return NoNode;
 
     if (CurTok == ';')
         getNextToken();
@@ -417,10 +409,10 @@ static std::unique_ptr<ExprAST> ParseWhileExpr() {
         return LogErrorParse("expected ';'. Got '" + tokop(CurTok) + "'\n" + 
                 "while loop statement must end with a ';', because return types are impossible.");
 
-    return std::make_unique<WhileExprAST>(std::move(Condition), std::move(Body));
+    return Nodes->whileExpr(Condition, Body);
 }
 
-static std::unique_ptr<ExprAST> ParseVarExpr() {
+static NodeRef ParseVarExpr() {
     if (ParseBlockStack.size() == 0) {
         return LogErrorParse("Variable must be contained in a block");
     }
@@ -435,8 +427,8 @@ static std::unique_ptr<ExprAST> ParseVarExpr() {
     if (dtype == type_void)
         return LogErrorParse("Variable expression can not be type void");
 
-    std::vector<std::string> VarNames;
-    std::vector<std::unique_ptr<ExprAST>> VarValues;
+    std::vector<Symbol> VarNames;
+    std::vector<NodeRef> VarValues;
 
     // At least one variable name is required
     if (CurTok != tok_identifier)
@@ -444,15 +436,7 @@ static std::unique_ptr<ExprAST> ParseVarExpr() {
 
     // Store each name
     while (true) {
-        std::string Name = IdentifierStr;
-        ParseBlockStack[BS_index]->localVariables.push_back(Name);
-        if (NamedValuesDatatype.count(Name) == 0){
-            NamedValuesDatatype[Name] = dtype;
-        }
-        else {
-            ParseBlockStack[BS_index]->outerVariables[Name] = NamedValuesDatatype[Name];
-        }
-        VarNames.push_back(Name);
+        VarNames.push_back(IdentifierSym);
         getNextToken(); // eat identifier
 
         // if end of var list, exit loop.
@@ -469,31 +453,38 @@ static std::unique_ptr<ExprAST> ParseVarExpr() {
 
     // Store each value
     while (true) {
-        std::unique_ptr<ExprAST> Init;
+        NodeRef Init;
         Init = ParseExpression();
-        if (!Init) return nullptr;
+        if (!Init) return NoNode;
 
-        if (Init->getDatatype() != dtype)
-            return LogErrorParse("Variable of type '"+dtypeToString(Init->getDatatype())+"' is used as an initilizer within a '"
+        if (typeOf(Init) != dtype)
+            return LogErrorParse("Variable of type '"+dtypeToString(typeOf(Init))+"' is used as an initilizer within a '"
                     + dtypeToString(dtype) + "' variable expression.");
         
-        VarValues.push_back(std::move(Init));
+        // Like codegen, only bring a name into scope after its initializer
+        if (VarValues.size() < VarNames.size())
+            NamedValuesDatatype.bind(VarNames[VarValues.size()], dtype);
+        VarValues.push_back(Init);
 
         // End of var list, exit loop.
         if (CurTok != ',') break;
         getNextToken(); // eat the ','.
     }
 
-    std::vector<std::pair<std::string, std::unique_ptr<ExprAST>>> VarPairs;
+    // Names sharing the one initializer
+    for (size_t i = VarValues.size(); i < VarNames.size(); i++)
+        NamedValuesDatatype.bind(VarNames[i], dtype);
+
+    std::vector<std::pair<Symbol, NodeRef>> VarPairs;
     if(VarNames.size() == VarValues.size()){
         for(int i = 0; i < VarValues.size(); i++){
-            VarPairs.push_back(std::make_pair(VarNames[i], std::move(VarValues[i])));
+            VarPairs.push_back(std::make_pair(VarNames[i], VarValues[i]));
         }
     }
     else if (VarValues.size() == 1){
-        VarPairs.push_back(std::make_pair(VarNames[0], std::move(VarValues[0])));
+        VarPairs.push_back(std::make_pair(VarNames[0], VarValues[0]));
         for(int i = 1; i < VarNames.size(); i++){
-            VarPairs.push_back(std::make_pair(VarNames[i], nullptr));
+            VarPairs.push_back(std::make_pair(VarNames[i], NoNode));
         }
     }
     else{
@@ -501,10 +492,10 @@ static std::unique_ptr<ExprAST> ParseVarExpr() {
                 std::to_string(VarNames.size()) + ") equal values(" + std::to_string(VarValues.size()) + ") or 1. ");
     }
 
-    return std::make_unique<VarExprAST>(std::move(VarPairs), dtype);
+    return Nodes->var(VarPairs, dtype);
 }
 
-static std::unique_ptr<ExprAST> ParsePrimary() {
+static NodeRef ParsePrimary() {
     switch(CurTok) {
     default:
         return LogErrorParse("Unknown token '" + tokop(CurTok) + "' when expecting an expression");
@@ -537,36 +528,38 @@ static int GetTokPrecedence() {
         return -1;
 
     //Make sure it is a declared binop.
-    if (BinopProperties.find(CurTok) == BinopProperties.end()) return -1;
-    return BinopProperties[CurTok].Precedence;
+    BinopProperty *Binop = BinopProperties.find(CurTok);
+    if (!Binop) return -1;
+    return Binop->Precedence;
 }
 
-static std::unique_ptr<ExprAST> ParseUnary() {
+static NodeRef ParseUnary() {
     // If the current token is not an operator, it must be a primary expr.
     if (CurTok < 0 || CurTok == '(' || CurTok == ',' || CurTok == '{')
         return ParsePrimary();
 
     // If this is a unary operator, read it.
     int Opc = CurTok;
-    if(UnopProperties.count(Opc) == 0){
+    UnopProperty *Unop = UnopProperties.find(Opc);
+    if(!Unop){
         return LogErrorParse("Unknown unary operator '" + tokop(Opc) + "'");
     }
 
     getNextToken();
     if (auto Operand = ParseUnary()){
-        DataType inputType = Operand->getDatatype();
-        if (UnopProperties[Opc].count(inputType) == 0){
+        DataType inputType = typeOf(Operand);
+        DataType returnType = Unop->result(inputType);
+        if (returnType == type_UNDECIDED){
             return LogErrorParse("Can not perform unary operator '" + tokop(Opc) +
                     "' with type '" + dtypeToString(inputType) + "'");
         }
 
-        return std::make_unique<UnaryExprAST>(Opc, std::move(Operand), UnopProperties[Opc][inputType]);
+        return Nodes->unary(Opc, Operand, returnType);
     }
-    return nullptr;
+    return NoNode;
 }
 
-static std::unique_ptr<ExprAST> ParseBinOpRHS(int ExprPrec,
-        std::unique_ptr<ExprAST> LHS) {
+static NodeRef ParseBinOpRHS(int ExprPrec, NodeRef LHS) {
     // If this is a binop, find its precedence.
     while (true) {
         int TokPrec = GetTokPrecedence();
@@ -584,38 +577,38 @@ static std::unique_ptr<ExprAST> ParseBinOpRHS(int ExprPrec,
         //Parse the unary expression after the binary operator.
         auto RHS = ParseUnary();
         if (!RHS)
-            return nullptr;
+            return NoNode;
 
         // If BinOp binds less tightly with RHS than the operator after RHS, let
         // the pending operator take RHS as its LHS.
         int NextPrec = GetTokPrecedence();
         if (TokPrec < NextPrec) {
-            RHS = ParseBinOpRHS(TokPrec+1, std::move(RHS));
+            RHS = ParseBinOpRHS(TokPrec+1, RHS);
             if(!RHS)
-                return nullptr;
+                return NoNode;
         }
         //Merge LHS/RHS.
 
-        std::pair<DataType, DataType> OperationTyping = std::make_pair(LHS->getDatatype(), RHS->getDatatype());
-
-        if(BinopProperties[BinOp].CompatibilityChart.count(OperationTyping) == 0) {
+        DataType returnType = BinopProperties.find(BinOp)->result(typeOf(LHS), typeOf(RHS));
+        if(returnType == type_UNDECIDED) {
             return LogErrorParse("Can not perform '" + tokop(BinOp) + "' operation between '" +
-                    dtypeToString(LHS->getDatatype()) + "' and '" + 
-                    dtypeToString(RHS->getDatatype()) + "'.");
+                    dtypeToString(typeOf(LHS)) + "' and '" + 
+                    dtypeToString(typeOf(RHS)) + "'.");
         }
-        DataType returnType = BinopProperties[BinOp].CompatibilityChart[OperationTyping];
 
-        LHS = std::make_unique<BinaryExprAST>(BinOp, std::move(LHS), std::move(RHS), returnType);
+        // Resolve the operand promotion once, so codegen does not have to
+        DataType expanded = getExpandType(typeOf(LHS), typeOf(RHS));
+        LHS = Nodes->binary(BinOp, LHS, RHS, returnType, expanded);
     }
 }
 
-static std::unique_ptr<ExprAST> ParseExpression() {
+static NodeRef ParseExpression() {
     auto LHS = ParseUnary();
     if (!LHS) {
-        return nullptr;
+        return NoNode;
     }
 
-    return ParseBinOpRHS(0, std::move(LHS));
+    return ParseBinOpRHS(0, LHS);
 }
 
 static std::unique_ptr<PrototypeAST> ParsePrototype() {
@@ -646,16 +639,18 @@ static std::unique_ptr<PrototypeAST> ParsePrototype() {
         if (CurTok < 0)
             return LogErrorParseP("Expected binary operator. Got '" + tokop(CurTok) + "' instead");
         FnName = "operator";
-        FnSufix = (char)CurTok;
         isOperator = true;
-        getNextToken();
-        if (isascii(CurTok) && CurTok != '(') {
-            FnSufix += (char)CurTok;
-            longops.push_back(optok(FnSufix));
+        // An operator the lexer does not know yet comes in pieces
+        do {
+            FnSufix += tokop(CurTok);
             getNextToken();
+        } while (CurTok > 0 && CurTok != '(');
+        for (char c : FnSufix) {
+            if (!ispunct((unsigned char)c))
+                return LogErrorParseP("Invalid character in operator '" + FnSufix + "'");
         }
         FnName += FnSufix;
-        OperatorName = optok(FnSufix);
+        OperatorName = FnSufix.size() > 1 ? longops.add(FnSufix) : optok(FnSufix);
 
         // Read the precedence if present.
         if (CurTok == tok_number) {
@@ -673,7 +668,7 @@ static std::unique_ptr<PrototypeAST> ParsePrototype() {
         return LogErrorParseP("Expected '(' in "+FnName+" prototype. Got '" + tokop(CurTok) + "'");
     getNextToken(); // Eat '('
 
-    std::vector<std::pair<std::string, DataType>> Arguments;
+    std::vector<std::pair<Symbol, DataType>> Arguments;
     std::vector<DataType> argsig;
     while (true){
         DataType dtype;
@@ -689,9 +684,9 @@ static std::unique_ptr<PrototypeAST> ParsePrototype() {
         if (CurTok != tok_identifier){
             return LogErrorParseP(FnName + " expected name after variable datatype '"+dtypeToString(dtype)+"' declaration");
         }
-        Arguments.push_back(std::make_pair(IdentifierStr, dtype));
+        Arguments.push_back(std::make_pair(IdentifierSym, dtype));
         argsig.push_back(dtype);
-        NamedValuesDatatype[IdentifierStr] = dtype;
+        NamedValuesDatatype.bind(IdentifierSym, dtype);
         getNextToken(); // Eat name
 
         if (CurTok != ',')
@@ -717,32 +712,31 @@ static std::unique_ptr<PrototypeAST> ParsePrototype() {
         BinaryPrecedence = defaultBinPrecedence;
     }
     // If this is a Binop, install it.
+    // Signatures it adds go over the rows of a built in operator.
     if(isOperator && Arguments.size() == 2){
-        if (BinopProperties.count(OperatorName) == 0){
-            BinopProperties[OperatorName] =
-                {(int)BinaryPrecedence, std::map<std::pair<DataType, DataType>, DataType>()};
-        }
-        auto sig = std::make_pair(Arguments[0].second, Arguments[1].second);
-        BinopProperties[OperatorName].CompatibilityChart[sig] = ReturnType;
+        BinopProperty &Binop = BinopProperties.add(OperatorName, {(int)BinaryPrecedence, emptyChart()});
+        Binop.CompatibilityChart[Arguments[0].second][Arguments[1].second] = ReturnType;
     }
     // If this is a Unop, install it
     if(isOperator && Arguments.size() == 1){
-        if (UnopProperties.count(OperatorName) == 0){
-            UnopProperties[OperatorName] = std::map<DataType, DataType>();
-        }
-        UnopProperties[OperatorName][Arguments[0].second] = ReturnType;
+        UnopProperty &Unop = UnopProperties.add(OperatorName, {emptyRow()});
+        Unop.Types[Arguments[0].second] = ReturnType;
     }
 
-    FunctionDataTypes[FnName] = std::make_pair(ReturnType, std::move(argsig));
+    Symbol FnSym = Identifiers.intern(FnName);
+    FunctionDataTypes[FnSym] = std::make_pair(ReturnType, std::move(argsig));
 
-    return std::make_unique<PrototypeAST>(FnName, std::move(Arguments), ReturnType, isOperator, BinaryPrecedence);
+    return std::make_unique<PrototypeAST>(FnSym, std::move(Arguments), ReturnType, isOperator, BinaryPrecedence);
 }
 
 std::unique_ptr<FunctionAST> ParseDefinition() {
     getNextToken(); // eat def.
+    ResetScopes();
     auto Proto = ParsePrototype();
     if (!Proto) return nullptr;
 
+    Tree T;
+    Nodes = &T;
     if (auto Body = ParseBlock()){
         if (CurTok == ';' && Proto->getDataType() != type_void) {
             LogErrorParse("Non null function block can not have ';'");
@@ -751,7 +745,7 @@ std::unique_ptr<FunctionAST> ParseDefinition() {
         if (CurTok == ';'){
             getNextToken(); // eat ;.
         }
-        return std::make_unique<FunctionAST>(std::move(Proto), std::move(Body));
+        return std::make_unique<FunctionAST>(std::move(Proto), std::move(T), Body);
     }
 
     return nullptr;
@@ -765,12 +759,16 @@ std::unique_ptr<PrototypeAST> ParseExtern() {
     return std::move(body);
 }
 
-std::unique_ptr<FunctionAST> ParseTopLevelExpr() {
+std::unique_ptr<FunctionAST> ParseTopLevelExpr(std::string Name) {
+    ResetScopes();
+    Tree T;
+    Nodes = &T;
     if (auto E = ParseLine()) {
         // Make an anonymous proto.
-        //FunctionDataTypes["__anon_expr"] = std::make_pair(E->getDatatype(), std::vector<DataType>());
-        auto Proto = std::make_unique<PrototypeAST>("__anon_expr", std::vector<std::pair<std::string, DataType>>(), E->getDatatype());
-        return std::make_unique<FunctionAST>(std::move(Proto), std::move(E));
+        //FunctionDataTypes["__anon_expr"] = std::make_pair(typeOf(E), std::vector<DataType>());
+        auto Proto = std::make_unique<PrototypeAST>(Identifiers.intern(Name),
+                std::vector<std::pair<Symbol, DataType>>(), typeOf(E));
+        return std::make_unique<FunctionAST>(std::move(Proto), std::move(T), E);
     }
     return nullptr;
 }
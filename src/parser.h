@@ -2,12 +2,13 @@
 #define PARSER
 
 #include <memory>
+#include <string>
 namespace AST {
     class FunctionAST;
     class PrototypeAST;
 }
 
-std::unique_ptr<AST::FunctionAST> ParseTopLevelExpr();
+std::unique_ptr<AST::FunctionAST> ParseTopLevelExpr(std::string Name = "__anon_expr");
 std::unique_ptr<AST::PrototypeAST> ParseExtern();
 std::unique_ptr<AST::FunctionAST> ParseDefinition();
 
@@ -0,0 +1,205 @@
+#include "./scan.h"
+#include <cstdint>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+struct Scanner {
+    const char *Name;
+    size_t (*Whitespace)(const char *, size_t, size_t);
+    size_t (*Identifier)(const char *, size_t, size_t);
+    size_t (*Number)(const char *, size_t, size_t);
+    size_t (*Comment)(const char *, size_t, size_t);
+};
+
+// Scalar versions, also used for the tails of the vector versions
+inline bool isSpaceChar(unsigned char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+inline bool isIdentChar(unsigned char c) {
+    return (c >= '0' && c <= '9') || (unsigned char)((c | 0x20) - 'a') <= 'z' - 'a' || c == '_';
+}
+inline bool isNumberChar(unsigned char c) {
+    return (c >= '0' && c <= '9') || c == '.';
+}
+inline bool isLineEnd(unsigned char c) {
+    return c == '\n' || c == '\r';
+}
+
+size_t scalarWhitespace(const char *Data, size_t i, size_t Size) {
+    while (i < Size && isSpaceChar(Data[i]))
+        i++;
+    return i;
+}
+size_t scalarIdentifier(const char *Data, size_t i, size_t Size) {
+    while (i < Size && isIdentChar(Data[i]))
+        i++;
+    return i;
+}
+size_t scalarNumber(const char *Data, size_t i, size_t Size) {
+    while (i < Size && isNumberChar(Data[i]))
+        i++;
+    return i;
+}
+size_t scalarComment(const char *Data, size_t i, size_t Size) {
+    while (i < Size && !isLineEnd(Data[i]))
+        i++;
+    return i;
+}
+
+#ifdef SCAN_X86
+
+// Most runs are only a few bytes long, so the first ones are checked one at
+// a time before any vector work is set up.
+const size_t ScalarPrefix = 8;
+
+// SSE4.2: the string compare instructions match character ranges directly,
+// and give the index of the first byte that is outside all of them.
+#define SSE42_SCANNER(Name, Ranges, Mode, Scalar)                                   \
+__attribute__((target("sse4.2")))                                                   \
+size_t Name(const char *Data, size_t i, size_t Size) {                              \
+    size_t Prefix = Scalar(Data, i, i + ScalarPrefix < Size ? i + ScalarPrefix : Size); \
+    if (Prefix < i + ScalarPrefix)                                                  \
+        return Prefix;                                                              \
+    i = Prefix;                                                                     \
+    const __m128i Set = _mm_loadu_si128((const __m128i *)Ranges "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0"); \
+    const int SetLength = sizeof(Ranges) - 1;                                       \
+    while (i + 16 <= Size) {                                                        \
+        __m128i Chunk = _mm_loadu_si128((const __m128i *)(Data + i));               \
+        int Index = _mm_cmpestri(Set, SetLength, Chunk, 16, Mode);                  \
+        if (Index != 16)                                                            \
+            return i + Index;                                                       \
+        i += 16;                                                                    \
+    }                                                                               \
+    return Scalar(Data, i, Size);                                                   \
+}
+
+SSE42_SCANNER(sse42Whitespace, "\t\r  ",
+        _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_NEGATIVE_POLARITY, scalarWhitespace)
+SSE42_SCANNER(sse42Identifier, "azAZ09__",
+        _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_NEGATIVE_POLARITY, scalarIdentifier)
+SSE42_SCANNER(sse42Number, "09..",
+        _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_NEGATIVE_POLARITY, scalarNumber)
+SSE42_SCANNER(sse42Comment, "\n\r",
+        _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY, scalarComment)
+
+#undef SSE42_SCANNER
+
+// AVX2: classify 32 bytes at a time with unsigned range compares, then find
+// the first byte outside the class in the movemask.
+__attribute__((target("avx2")))
+inline __m256i inRange(__m256i Chunk, char Low, char High) {
+    __m256i Offset = _mm256_sub_epi8(Chunk, _mm256_set1_epi8(Low));
+    __m256i Limit = _mm256_set1_epi8((char)(High - Low));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(Offset, Limit), Offset);
+}
+
+__attribute__((target("avx2")))
+inline __m256i isChar(__m256i Chunk, char C) {
+    return _mm256_cmpeq_epi8(Chunk, _mm256_set1_epi8(C));
+}
+
+#define AVX2_SCANNER(Name, Match, Scalar)                                       \
+__attribute__((target("avx2,bmi")))                                             \
+size_t Name(const char *Data, size_t i, size_t Size) {                          \
+    size_t Prefix = Scalar(Data, i, i + ScalarPrefix < Size ? i + ScalarPrefix : Size); \
+    if (Prefix < i + ScalarPrefix)                                              \
+        return Prefix;                                                          \
+    i = Prefix;                                                                 \
+    while (i + 32 <= Size) {                                                    \
+        __m256i Chunk = _mm256_loadu_si256((const __m256i *)(Data + i));        \
+        uint32_t Stop = ~(uint32_t)_mm256_movemask_epi8(Match);                 \
+        if (Stop != 0)                                                          \
+            return i + __builtin_ctz(Stop);                                     \
+        i += 32;                                                                \
+    }                                                                           \
+    return Scalar(Data, i, Size);                                               \
+}
+
+AVX2_SCANNER(avx2Whitespace,
+        _mm256_or_si256(isChar(Chunk, ' '), inRange(Chunk, '\t', '\r')), scalarWhitespace)
+AVX2_SCANNER(avx2Identifier,
+        _mm256_or_si256(
+            _mm256_or_si256(inRange(Chunk, '0', '9'),
+                inRange(_mm256_or_si256(Chunk, _mm256_set1_epi8(0x20)), 'a', 'z')),
+            isChar(Chunk, '_')), scalarIdentifier)
+AVX2_SCANNER(avx2Number,
+        _mm256_or_si256(inRange(Chunk, '0', '9'), isChar(Chunk, '.')), scalarNumber)
+AVX2_SCANNER(avx2Comment,
+        _mm256_andnot_si256(_mm256_or_si256(isChar(Chunk, '\n'), isChar(Chunk, '\r')),
+            _mm256_set1_epi8(-1)), scalarComment)
+
+#undef AVX2_SCANNER
+
+#endif
+
+const Scanner Scanners[] = {
+#ifdef SCAN_X86
+    {"avx2", avx2Whitespace, avx2Identifier, avx2Number, avx2Comment},
+    {"sse4.2", sse42Whitespace, sse42Identifier, sse42Number, sse42Comment},
+#endif
+    {"scalar", scalarWhitespace, scalarIdentifier, scalarNumber, scalarComment},
+};
+
+bool isSupported(const Scanner &S) {
+#ifdef SCAN_X86
+    if (strcmp(S.Name, "avx2") == 0)
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi");
+    if (strcmp(S.Name, "sse4.2") == 0)
+        return __builtin_cpu_supports("sse4.2");
+#endif
+    return true;
+}
+
+const Scanner *selectScanner() {
+    for (const Scanner &S : Scanners) {
+        if (isSupported(S))
+            return &S;
+    }
+    return &Scanners[0];
+}
+
+const Scanner *Active = selectScanner();
+
+}
+
+size_t scanWhitespace(const char *Data, size_t From, size_t Size) {
+    return Active->Whitespace(Data, From, Size);
+}
+size_t scanIdentifier(const char *Data, size_t From, size_t Size) {
+    return Active->Identifier(Data, From, Size);
+}
+size_t scanNumber(const char *Data, size_t From, size_t Size) {
+    return Active->Number(Data, From, Size);
+}
+size_t scanComment(const char *Data, size_t From, size_t Size) {
+    return Active->Comment(Data, From, Size);
+}
+
+std::vector<const char *> getScanImplementations() {
+    std::vector<const char *> Names;
+    for (const Scanner &S : Scanners) {
+        if (isSupported(S))
+            Names.push_back(S.Name);
+    }
+    return Names;
+}
+
+const char *getScanImplementation() {
+    return Active->Name;
+}
+
+bool setScanImplementation(const char *Name) {
+    for (const Scanner &S : Scanners) {
+        if (strcmp(S.Name, Name) == 0 && isSupported(S)) {
+            Active = &S;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,26 @@
+#ifndef SCAN
+#define SCAN
+
+#include <cstddef>
+#include <vector>
+
+// Run scanners used by the lexer. Each returns the offset of the first byte
+// in Data[From, Size) that is not part of the run, or Size if the run goes to
+// the end of the input.
+
+/// scanWhitespace - Skip the characters isspace accepts
+size_t scanWhitespace(const char *Data, size_t From, size_t Size);
+/// scanIdentifier - Skip [A-Za-z0-9_]
+size_t scanIdentifier(const char *Data, size_t From, size_t Size);
+/// scanNumber - Skip [0-9.]
+size_t scanNumber(const char *Data, size_t From, size_t Size);
+/// scanComment - Skip to the next '\n' or '\r'
+size_t scanComment(const char *Data, size_t From, size_t Size);
+
+/// Names of the implementations this CPU supports, fastest first. The
+/// fastest one is used by default.
+std::vector<const char *> getScanImplementations();
+const char *getScanImplementation();
+bool setScanImplementation(const char *Name);
+
+#endif
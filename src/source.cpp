@@ -0,0 +1,154 @@
+#include "./source.h"
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <iterator>
+#include <utility>
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+SourceBuffer::~SourceBuffer() {
+#ifndef _WIN32
+    if (Mapped)
+        munmap(const_cast<char *>(Data), Size);
+#endif
+}
+
+std::unique_ptr<SourceBuffer> SourceBuffer::fromString(std::string Text) {
+    std::unique_ptr<SourceBuffer> Buffer(new SourceBuffer());
+    Buffer->Owned = std::move(Text);
+    Buffer->Data = Buffer->Owned.data();
+    Buffer->Size = Buffer->Owned.size();
+    return Buffer;
+}
+
+std::unique_ptr<SourceBuffer> SourceBuffer::fromStream(std::istream &In) {
+    std::unique_ptr<SourceBuffer> Buffer(new SourceBuffer());
+    Buffer->Stream = &In;
+    return Buffer;
+}
+
+bool SourceBuffer::readLine() {
+    std::string Line;
+    if (!Stream || !std::getline(*Stream, Line))
+        return false;
+    Line += '\n';
+
+    if (Size + Line.size() > Capacity) {
+        Capacity = std::max({Capacity * 2, Size + Line.size(), (size_t)256});
+        std::unique_ptr<char[]> Grown(new char[Capacity]);
+        if (Size)
+            memcpy(Grown.get(), Data, Size);
+        Storage = std::move(Grown);
+        Data = Storage.get();
+    }
+    memcpy(Storage.get() + Size, Line.data(), Line.size());
+    Size += Line.size();
+    return true;
+}
+
+void SourceBuffer::discard(size_t N) {
+    N = std::min(N, Size);
+    if (!Stream || !N)
+        return;
+    memmove(Storage.get(), Storage.get() + N, Size - N);
+    Size -= N;
+}
+
+std::unique_ptr<SourceBuffer> SourceBuffer::fromFile(const char *Path) {
+#ifdef _WIN32
+    // No mapping here, read the whole file in one go instead.
+    std::ifstream File(Path, std::ios::binary);
+    if (!File)
+        return nullptr;
+    return fromString(std::string(std::istreambuf_iterator<char>(File),
+                std::istreambuf_iterator<char>()));
+#else
+    int FD = open(Path, O_RDONLY);
+    if (FD < 0)
+        return nullptr;
+
+    struct stat Stat;
+    if (fstat(FD, &Stat) != 0) {
+        close(FD);
+        return nullptr;
+    }
+
+    // Empty files can't be mapped
+    if (Stat.st_size == 0) {
+        close(FD);
+        return fromString("");
+    }
+
+    void *Addr = mmap(nullptr, Stat.st_size, PROT_READ, MAP_PRIVATE, FD, 0);
+    close(FD);
+    if (Addr == MAP_FAILED)
+        return nullptr;
+    // The lexer reads the file front to back
+    madvise(Addr, Stat.st_size, MADV_SEQUENTIAL);
+
+    std::unique_ptr<SourceBuffer> Buffer(new SourceBuffer());
+    Buffer->Data = static_cast<const char *>(Addr);
+    Buffer->Size = Stat.st_size;
+    Buffer->Mapped = true;
+    return Buffer;
+#endif
+}
+
+SourceManager SourceMgr;
+
+unsigned SourceManager::addBuffer(std::string Name, std::unique_ptr<SourceBuffer> Buffer) {
+    Buffers.push_back({std::move(Name), std::move(Buffer), {}});
+    return Buffers.size() - 1;
+}
+
+location SourceManager::getLocation(unsigned ID, size_t Offset) {
+    Entry &E = Buffers[ID];
+    std::string_view Text = E.Buffer->text();
+    if (E.LineStarts.empty())
+        E.LineStarts.push_back(0);
+    // Streams can have grown since the last lookup, only index the new text
+    if (E.Indexed < Text.size()) {
+        const char *Begin = Text.data();
+        const char *End = Begin + Text.size();
+        for (const char *p = Begin + E.Indexed; (p = (const char *)memchr(p, '\n', End - p)); p++)
+            E.LineStarts.push_back(p + 1 - Begin);
+        E.Indexed = Text.size();
+    }
+    Offset = std::min(Offset, Text.size());
+    // The last line starting at or before Offset
+    auto Line = std::upper_bound(E.LineStarts.begin(), E.LineStarts.end(), Offset) - 1;
+    return {E.LinesDiscarded + (int)(Line - E.LineStarts.begin()) + 1,
+        (int)(Offset - *Line) + 1, ID};
+}
+
+size_t SourceManager::discard(unsigned ID, size_t Offset) {
+    Entry &E = Buffers[ID];
+    if (!E.Buffer->isStream())
+        return 0;
+    // Index up to the end first, so every dropped line is counted
+    getLocation(ID, Offset);
+    auto Line = std::upper_bound(E.LineStarts.begin(), E.LineStarts.end(), Offset) - 1;
+    size_t Dropped = *Line;
+    if (!Dropped)
+        return 0;
+
+    E.LinesDiscarded += Line - E.LineStarts.begin();
+    E.LineStarts.erase(E.LineStarts.begin(), Line);
+    for (uint32_t &Start : E.LineStarts)
+        Start -= Dropped;
+    E.Indexed -= Dropped;
+    E.Buffer->discard(Dropped);
+    return Dropped;
+}
+
+void SourceManager::clear() {
+    Buffers.clear();
+}
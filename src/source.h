@@ -0,0 +1,108 @@
+#ifndef SOURCE
+#define SOURCE
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct location {
+    int line;
+    int col;
+    // The SourceManager id of the buffer. Its name is looked up when the
+    // location is printed, since adding buffers can move the names.
+    unsigned buffer;
+
+    static constexpr unsigned NoBuffer = ~0u;
+};
+
+/// SourceBuffer - The text the lexer reads from. Files are memory mapped, so
+/// tokens can point straight into them without copying. Streams are read a
+/// line at a time as the lexer asks for more.
+class SourceBuffer {
+    const char *Data = nullptr;
+    size_t Size = 0;
+    bool Mapped = false;
+    std::string Owned;
+
+    // Streams only. Growing and discarding both move the text, so only
+    // offsets into a stream stay meaningful across a readLine or discard.
+    std::istream *Stream = nullptr;
+    std::unique_ptr<char[]> Storage;
+    size_t Capacity = 0;
+
+    SourceBuffer() = default;
+
+public:
+    SourceBuffer(const SourceBuffer &) = delete;
+    SourceBuffer &operator=(const SourceBuffer &) = delete;
+    ~SourceBuffer();
+
+    /// fromFile - Map the file at Path. Returns null if it can not be read.
+    static std::unique_ptr<SourceBuffer> fromFile(const char *Path);
+    static std::unique_ptr<SourceBuffer> fromString(std::string Text);
+    /// fromStream - An empty buffer that readLine() fills from In.
+    static std::unique_ptr<SourceBuffer> fromStream(std::istream &In);
+
+    /// readLine - Append the next line of the stream, with its newline.
+    /// Returns false at the end of the stream, or if this is not a stream.
+    bool readLine();
+
+    /// discard - Drop the first N bytes of a stream, moving the rest to the
+    /// front. Does nothing if this is not a stream.
+    void discard(size_t N);
+
+    bool isStream() const {
+        return Stream != nullptr;
+    }
+
+    std::string_view text() const {
+        return std::string_view(Data, Size);
+    }
+};
+
+/// SourceManager - Owns every buffer loaded since the last clear(), so
+/// tokens and diagnostics can still refer to them. Offsets are only turned
+/// into lines and columns when a diagnostic asks for one; the table of line
+/// starts for a buffer is built the first time that happens.
+class SourceManager {
+    struct Entry {
+        std::string Name;
+        std::unique_ptr<SourceBuffer> Buffer;
+        std::vector<uint32_t> LineStarts; // Empty until first needed
+        size_t Indexed = 0; // Bytes LineStarts covers
+        int LinesDiscarded = 0;
+    };
+    std::vector<Entry> Buffers;
+
+public:
+    /// addBuffer - Take ownership of Buffer, returning the id to refer to
+    /// it by.
+    unsigned addBuffer(std::string Name, std::unique_ptr<SourceBuffer> Buffer);
+
+    std::string_view text(unsigned ID) const {
+        return Buffers[ID].Buffer->text();
+    }
+    const std::string &name(unsigned ID) const {
+        return Buffers[ID].Name;
+    }
+
+    /// getLocation - The line and column of the byte at Offset in buffer ID,
+    /// both counted from 1.
+    location getLocation(unsigned ID, size_t Offset);
+
+    /// discard - Drop the lines of stream ID before the one holding Offset,
+    /// so reading a long stream does not keep all of it. Later offsets move
+    /// down by the returned number of bytes, and line numbers carry on from
+    /// where they were.
+    size_t discard(unsigned ID, size_t Offset);
+
+    void clear();
+};
+
+extern SourceManager SourceMgr;
+
+#endif
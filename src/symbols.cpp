@@ -0,0 +1,14 @@
+#include "./symbols.h"
+#include <utility>
+
+Interner Identifiers;
+
+Symbol Interner::intern(std::string_view Name) {
+    auto It = Ids.find(Name);
+    if (It != Ids.end())
+        return It->second;
+    Symbol S = Names.size();
+    Names.emplace_back(Name);
+    Ids.emplace(Names.back(), S);
+    return S;
+}
@@ -0,0 +1,138 @@
+#ifndef SYMBOLS
+#define SYMBOLS
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/// Symbol - An interned identifier. Two names are the same exactly when
+/// their symbols are, and symbols are handed out from 0 up, so tables can
+/// be plain vectors indexed by them.
+typedef uint32_t Symbol;
+
+/// Interner - Hands out one Symbol per distinct name, for the whole session.
+class Interner {
+    std::deque<std::string> Names; // A deque, so the keys below stay valid
+    std::unordered_map<std::string_view, Symbol> Ids;
+
+public:
+    Symbol intern(std::string_view Name);
+
+    const std::string &name(Symbol S) const {
+        return Names[S];
+    }
+    size_t size() const {
+        return Names.size();
+    }
+};
+
+extern Interner Identifiers;
+
+/// SymbolMap - A map from symbols to T, stored densely. Lookups are an index,
+/// and reading a missing entry through [] adds it, like std::map.
+template <typename T>
+class SymbolMap {
+    std::vector<T> Values;
+    std::vector<bool> Present;
+
+public:
+    size_t count(Symbol S) const {
+        return S < Present.size() && Present[S];
+    }
+
+    T &operator[](Symbol S) {
+        if (S >= Values.size()) {
+            size_t Size = std::max<size_t>(S + 1, Identifiers.size());
+            Values.resize(Size);
+            Present.resize(Size);
+        }
+        Present[S] = true;
+        return Values[S];
+    }
+
+    /// find - The entry for S, or null if there is none.
+    T *find(Symbol S) {
+        return count(S) ? &Values[S] : nullptr;
+    }
+
+    void erase(Symbol S) {
+        if (count(S)) {
+            Present[S] = false;
+            Values[S] = T();
+        }
+    }
+
+    void clear() {
+        Values.clear();
+        Present.clear();
+    }
+};
+
+/// ScopedSymbolMap - A SymbolMap with nested scopes. Each binding logs what
+/// it hid, so leaving a scope only walks back the names bound inside it.
+template <typename T>
+class ScopedSymbolMap {
+    struct Undo {
+        Symbol Name;
+        bool Had;
+        T Old;
+    };
+    SymbolMap<T> Map;
+    std::vector<Undo> Log;
+    std::vector<size_t> Scopes;
+
+public:
+    size_t count(Symbol S) const {
+        return Map.count(S);
+    }
+
+    /// find - The innermost binding of S, or null if there is none.
+    T *find(Symbol S) {
+        return Map.find(S);
+    }
+
+    /// bind - Bind S to Value in the current scope, hiding any outer binding.
+    void bind(Symbol S, T Value) {
+        if (T *Old = Map.find(S))
+            Log.push_back({S, true, *Old});
+        else
+            Log.push_back({S, false, T()});
+        Map[S] = Value;
+    }
+
+    void enterScope() {
+        Scopes.push_back(Log.size());
+    }
+
+    /// exitScope - Undo every binding made since the matching enterScope.
+    void exitScope() {
+        unwind(Scopes.back());
+        Scopes.pop_back();
+    }
+
+    /// clear - Drop every binding and scope, including ones left open by an
+    /// error. Every binding is logged, so this only touches the bound names.
+    void clear() {
+        unwind(0);
+        Scopes.clear();
+    }
+
+private:
+    void unwind(size_t Mark) {
+        while (Log.size() > Mark) {
+            Undo &U = Log.back();
+            if (U.Had)
+                Map[U.Name] = U.Old;
+            else
+                Map.erase(U.Name);
+            Log.pop_back();
+        }
+    }
+};
+
+#endif